@@ -0,0 +1,665 @@
+/*
+  bench.c: unpacking throughput benchmark for vsrawsource
+
+  This file is a part of vsrawsource
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with Libav; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+/* links the plugin objects against a minimal stand-in for the core, then
+   decodes frames of a synthetic file in every source format through the
+   memory mapped path, so that what gets measured is the unpacking. */
+
+#include "rawsource.h"
+#include "unpack.h"
+#include "VapourSynth.h"
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+#define MAP_MAX_ITEMS 16
+#define MAX_SPARE_FRAMES 8
+#define BENCH_FILE_SIZE ((int64_t)7680 * 4320 * 6 + 65536)
+
+
+typedef struct {
+    const char *key;
+    int64_t value;
+    const char *data;
+} map_item_t;
+
+struct VSMap {
+    int num_items;
+    map_item_t items[MAP_MAX_ITEMS];
+    char error[256];
+};
+
+struct VSFrameRef {
+    const VSFormat *format;
+    int width;
+    int height;
+    int refs;
+    int stride[3];
+    uint8_t *data[3];
+    VSMap props;
+};
+
+struct VSFrameContext {
+    int output;
+    const char *error;
+};
+
+struct VSCore {
+    VSCoreInfo info;
+};
+
+struct VSNode {
+    VSVideoInfo vi[2];
+    int num_outputs;
+};
+
+
+static const struct {
+    int id;
+    int color_family;
+    int sample_type;
+    int bits;
+    int sub_w;
+    int sub_h;
+} presets[] = {
+    { pfGray8,     cmGray, stInteger,  8, 0, 0 },
+    { pfGray16,    cmGray, stInteger, 16, 0, 0 },
+    { pfGrayH,     cmGray, stFloat,   16, 0, 0 },
+    { pfGrayS,     cmGray, stFloat,   32, 0, 0 },
+    { pfYUV420P8,  cmYUV,  stInteger,  8, 1, 1 },
+    { pfYUV422P8,  cmYUV,  stInteger,  8, 1, 0 },
+    { pfYUV444P8,  cmYUV,  stInteger,  8, 0, 0 },
+    { pfYUV410P8,  cmYUV,  stInteger,  8, 2, 2 },
+    { pfYUV411P8,  cmYUV,  stInteger,  8, 2, 0 },
+    { pfYUV440P8,  cmYUV,  stInteger,  8, 0, 1 },
+    { pfYUV420P9,  cmYUV,  stInteger,  9, 1, 1 },
+    { pfYUV422P9,  cmYUV,  stInteger,  9, 1, 0 },
+    { pfYUV444P9,  cmYUV,  stInteger,  9, 0, 0 },
+    { pfYUV420P10, cmYUV,  stInteger, 10, 1, 1 },
+    { pfYUV422P10, cmYUV,  stInteger, 10, 1, 0 },
+    { pfYUV444P10, cmYUV,  stInteger, 10, 0, 0 },
+    { pfYUV420P16, cmYUV,  stInteger, 16, 1, 1 },
+    { pfYUV422P16, cmYUV,  stInteger, 16, 1, 0 },
+    { pfYUV444P16, cmYUV,  stInteger, 16, 0, 0 },
+    { pfRGB24,     cmRGB,  stInteger,  8, 0, 0 },
+    { pfRGB27,     cmRGB,  stInteger,  9, 0, 0 },
+    { pfRGB30,     cmRGB,  stInteger, 10, 0, 0 },
+    { pfRGB48,     cmRGB,  stInteger, 16, 0, 0 },
+};
+
+static VSFormat formats[sizeof presets / sizeof presets[0]];
+
+/* the src_fmt names of the format table in check_args, and some of their
+   big-endian variants. packed ones go through a row kernel and are
+   measured at every cpu level. */
+static const struct {
+    const char *name;
+    int packed;
+} source_formats[] = {
+    { "i420",      0 }, { "IYUV",      0 }, { "YV12",      0 }, { "YUV420P8",  0 },
+    { "i422",      0 }, { "YV16",      0 }, { "YUV422P8",  0 }, { "i444",      0 },
+    { "YV24",      0 }, { "YUV444P8",  0 }, { "Y8",        0 }, { "Y800",      0 },
+    { "GRAY",      0 }, { "GRAY16",    0 }, { "GRAYH",     0 }, { "GRAYS",     0 },
+    { "YV411",     0 }, { "YUV411P8",  0 }, { "YUV9",      0 }, { "YVU9",      0 },
+    { "YUV410P8",  0 }, { "YUV440P8",  0 }, { "YUV420P9",  0 }, { "YUV420P10", 0 },
+    { "YUV420P16", 0 }, { "YUV422P9",  0 }, { "YUV422P10", 0 }, { "YUV422P16", 0 },
+    { "YUV444P9",  0 }, { "YUV444P10", 0 }, { "YUV444P16", 0 }, { "YUV444P8A", 0 },
+    { "YUY2",      1 }, { "YUYV",      1 }, { "UYVY",      1 }, { "YVYU",      1 },
+    { "VYUY",      1 }, { "BGR",       1 }, { "RGB",       1 }, { "BGRA",      1 },
+    { "ABGR",      1 }, { "RGBA",      1 }, { "ARGB",      1 }, { "AYUV",      1 },
+    { "GBRP8",     0 }, { "RGBP8",     0 }, { "GBRP9",     0 }, { "RGBP9",     0 },
+    { "GBRP10",    0 }, { "RGBP10",    0 }, { "GBRP16",    0 }, { "RGBP16",    0 },
+    { "BGR48",     1 }, { "RGB48",     1 }, { "NV12",      1 }, { "NV21",      1 },
+    { "P010",      1 }, { "P016",      1 }, { "P210",      1 }, { "P216",      1 },
+    /* big-endian planes are byte-swapped by a row kernel as well. */
+    { "GRAY16BE",  1 }, { "GRAYSBE",   1 }, { "YUV420P10BE", 1 }, { "YUV444P16BE", 1 },
+    { "RGBP16BE",  1 }, { "RGB48BE",   1 }, { "P010BE",    1 }, { "P216BE",    1 },
+};
+
+static const struct {
+    const char *name;
+    int width;
+    int height;
+} resolutions[] = {
+    { "SD",    720,  480 },
+    { "1080p", 1920, 1080 },
+    { "4K",    3840, 2160 },
+    { "8K",    7680, 4320 },
+};
+
+
+/* the filter created by the last call of the source function. */
+static struct {
+    VSNode node;
+    void *instance;
+    VSFilterGetFrame get_frame;
+    VSFilterFree free;
+} filter;
+
+static VSPublicFunction create_source;
+
+VS_EXTERNAL_API(void) VapourSynthPluginInit(VSConfigPlugin f_config,
+                                            VSRegisterFunction f_register,
+                                            VSPlugin *plugin);
+
+/* freed frames are kept for reuse, so that page faults of fresh
+   allocations do not end up in the numbers. */
+static VSFrameRef *spare_frames[MAX_SPARE_FRAMES];
+static int num_spare_frames;
+
+
+static map_item_t *find_item(const VSMap *map, const char *key)
+{
+    for (int i = 0; i < map->num_items; i++) {
+        if (strcmp(map->items[i].key, key) == 0) {
+            return (map_item_t *)&map->items[i];
+        }
+    }
+    return NULL;
+}
+
+
+static map_item_t *set_item(VSMap *map, const char *key)
+{
+    map_item_t *item = find_item(map, key);
+    if (!item && map->num_items < MAP_MAX_ITEMS) {
+        item = &map->items[map->num_items++];
+        item->key = key;
+    }
+    return item;
+}
+
+
+static int64_t VS_CC
+prop_get_int(const VSMap *map, const char *key, int index, int *error)
+{
+    map_item_t *item = find_item(map, key);
+    if (error) {
+        *error = item && !item->data ? 0 : peUnset;
+    }
+    return item ? item->value : 0;
+}
+
+
+static const char * VS_CC
+prop_get_data(const VSMap *map, const char *key, int index, int *error)
+{
+    map_item_t *item = find_item(map, key);
+    if (error) {
+        *error = item && item->data ? 0 : peUnset;
+    }
+    return item ? item->data : NULL;
+}
+
+
+static int VS_CC
+prop_num_elements(const VSMap *map, const char *key)
+{
+    return find_item(map, key) ? 1 : -1;
+}
+
+
+static int VS_CC
+prop_set_int(VSMap *map, const char *key, int64_t i, int append)
+{
+    map_item_t *item = set_item(map, key);
+    if (!item) {
+        return 1;
+    }
+    item->value = i;
+    item->data = NULL;
+    return 0;
+}
+
+
+static void VS_CC set_error(VSMap *map, const char *error_message)
+{
+    snprintf(map->error, sizeof map->error, "%s", error_message);
+}
+
+
+static void VS_CC
+set_filter_error(const char *error_message, VSFrameContext *frame_ctx)
+{
+    frame_ctx->error = error_message;
+}
+
+
+static int VS_CC get_output_index(VSFrameContext *frame_ctx)
+{
+    return frame_ctx->output;
+}
+
+
+static const VSCoreInfo * VS_CC get_core_info(VSCore *core)
+{
+    return &core->info;
+}
+
+
+static const VSFormat * VS_CC get_format_preset(int id, VSCore *core)
+{
+    for (size_t i = 0; i < sizeof presets / sizeof presets[0]; i++) {
+        if (presets[i].id != id) {
+            continue;
+        }
+        VSFormat *f = &formats[i];
+        if (f->bitsPerSample == 0) {
+            snprintf(f->name, sizeof f->name, "preset%d", id);
+            f->id = id;
+            f->colorFamily = presets[i].color_family;
+            f->sampleType = presets[i].sample_type;
+            f->bitsPerSample = presets[i].bits;
+            f->bytesPerSample = presets[i].bits > 16 ? 4 : presets[i].bits > 8 ? 2 : 1;
+            f->subSamplingW = presets[i].sub_w;
+            f->subSamplingH = presets[i].sub_h;
+            f->numPlanes = presets[i].color_family == cmGray ? 1 : 3;
+        }
+        return f;
+    }
+    return NULL;
+}
+
+
+static void release_frame(VSFrameRef *f)
+{
+    for (int p = 0; p < 3; p++) {
+        rs_aligned_free(f->data[p]);
+    }
+    free(f);
+}
+
+
+static void flush_spare_frames(void)
+{
+    while (num_spare_frames > 0) {
+        release_frame(spare_frames[--num_spare_frames]);
+    }
+}
+
+
+static VSFrameRef * VS_CC
+new_video_frame(const VSFormat *format, int width, int height,
+                const VSFrameRef *prop_src, VSCore *core)
+{
+    for (int i = 0; i < num_spare_frames; i++) {
+        VSFrameRef *f = spare_frames[i];
+        if (f->format == format && f->width == width && f->height == height) {
+            spare_frames[i] = spare_frames[--num_spare_frames];
+            f->refs = 1;
+            f->props.num_items = 0;
+            return f;
+        }
+    }
+
+    VSFrameRef *f = (VSFrameRef *)calloc(1, sizeof(VSFrameRef));
+    if (!f) {
+        return NULL;
+    }
+    f->format = format;
+    f->width = width;
+    f->height = height;
+    f->refs = 1;
+    for (int p = 0; p < format->numPlanes; p++) {
+        int w = width >> (p ? format->subSamplingW : 0);
+        int h = height >> (p ? format->subSamplingH : 0);
+        f->stride[p] = (w * format->bytesPerSample + 31) & ~31;
+        f->data[p] = rs_aligned_malloc((size_t)f->stride[p] * h, 32);
+        if (!f->data[p]) {
+            release_frame(f);
+            return NULL;
+        }
+        memset(f->data[p], 0, (size_t)f->stride[p] * h);
+    }
+    return f;
+}
+
+
+static const VSFrameRef * VS_CC clone_frame_ref(const VSFrameRef *f)
+{
+    ((VSFrameRef *)f)->refs++;
+    return f;
+}
+
+
+static void VS_CC free_frame(const VSFrameRef *cf)
+{
+    VSFrameRef *f = (VSFrameRef *)cf;
+    if (!f || --f->refs > 0) {
+        return;
+    }
+    if (num_spare_frames < MAX_SPARE_FRAMES) {
+        spare_frames[num_spare_frames++] = f;
+    } else {
+        release_frame(f);
+    }
+}
+
+
+static int VS_CC get_stride(const VSFrameRef *f, int plane)
+{
+    return f->stride[plane];
+}
+
+
+static uint8_t * VS_CC get_write_ptr(VSFrameRef *f, int plane)
+{
+    return f->data[plane];
+}
+
+
+static int VS_CC get_frame_width(const VSFrameRef *f, int plane)
+{
+    return f->width >> (plane ? f->format->subSamplingW : 0);
+}
+
+
+static int VS_CC get_frame_height(const VSFrameRef *f, int plane)
+{
+    return f->height >> (plane ? f->format->subSamplingH : 0);
+}
+
+
+static VSMap * VS_CC get_frame_props_rw(VSFrameRef *f)
+{
+    return &f->props;
+}
+
+
+static void VS_CC set_video_info(const VSVideoInfo *vi, int num_outputs, VSNode *node)
+{
+    for (int i = 0; i < num_outputs; i++) {
+        node->vi[i] = vi[i];
+    }
+    node->num_outputs = num_outputs;
+}
+
+
+static const VSAPI api;
+
+static void VS_CC
+create_filter(const VSMap *in, VSMap *out, const char *name, VSFilterInit init,
+              VSFilterGetFrame get_frame, VSFilterFree free_func, int filter_mode,
+              int flags, void *instance_data, VSCore *core)
+{
+    filter.instance = instance_data;
+    filter.get_frame = get_frame;
+    filter.free = free_func;
+    init((VSMap *)in, out, &filter.instance, &filter.node, core, &api);
+}
+
+
+static const VSAPI api = {
+    .createFilter = create_filter,
+    .setError = set_error,
+    .setFilterError = set_filter_error,
+    .getOutputIndex = get_output_index,
+    .getCoreInfo = get_core_info,
+    .getFormatPreset = get_format_preset,
+    .newVideoFrame = new_video_frame,
+    .cloneFrameRef = clone_frame_ref,
+    .freeFrame = free_frame,
+    .getStride = get_stride,
+    .getWritePtr = get_write_ptr,
+    .getFrameWidth = get_frame_width,
+    .getFrameHeight = get_frame_height,
+    .getFramePropsRW = get_frame_props_rw,
+    .propGetInt = prop_get_int,
+    .propGetData = prop_get_data,
+    .propNumElements = prop_num_elements,
+    .propSetInt = prop_set_int,
+    .setVideoInfo = set_video_info,
+};
+
+
+static void VS_CC
+config_plugin(const char *identifier, const char *default_namespace,
+              const char *name, int api_version, int readonly, VSPlugin *plugin)
+{
+}
+
+
+static void VS_CC
+register_function(const char *name, const char *args, VSPublicFunction args_func,
+                  void *function_data, VSPlugin *plugin)
+{
+    if (strcmp(name, "Source") == 0) {
+        create_source = args_func;
+    }
+}
+
+
+static double get_time(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+
+static const char *create_bench_file(void)
+{
+    static char path[1024];
+    const char *dir = getenv("TMPDIR");
+#ifdef _WIN32
+    if (!dir) {
+        dir = getenv("TEMP");
+    }
+#endif
+    snprintf(path, sizeof path, "%s/vsrawsource_bench.raw", dir ? dir : ".");
+
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        return NULL;
+    }
+
+    /* xorshift noise, the kernels do not branch on the data anyway. */
+    uint32_t buff[1 << 16];
+    uint32_t x = 2463534242U;
+    for (int64_t written = 0; written < BENCH_FILE_SIZE; written += sizeof buff) {
+        for (size_t i = 0; i < sizeof buff / sizeof buff[0]; i++) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            buff[i] = x;
+        }
+        if (fwrite(buff, sizeof buff, 1, fp) != 1) {
+            fclose(fp);
+            remove(path);
+            return NULL;
+        }
+    }
+    fclose(fp);
+
+    return path;
+}
+
+
+static int64_t output_bytes(const VSNode *node)
+{
+    int64_t bytes = 0;
+    for (int i = 0; i < node->num_outputs; i++) {
+        const VSVideoInfo *vi = &node->vi[i];
+        const VSFormat *f = vi->format;
+        for (int p = 0; p < f->numPlanes; p++) {
+            int64_t w = vi->width >> (p ? f->subSamplingW : 0);
+            int64_t h = vi->height >> (p ? f->subSamplingH : 0);
+            bytes += w * h * f->bytesPerSample;
+        }
+    }
+    return bytes;
+}
+
+
+/* decodes frames until min_time has passed and prints the throughput. */
+static void run_case(const char *path, const char *format, int res, const char *level,
+                     const char *io, int threads, int nt_store, double min_time,
+                     VSCore *core)
+{
+    VSMap in = { 0 }, out = { 0 };
+    in.items[0] = (map_item_t){ "source", 0, path };
+    in.items[1] = (map_item_t){ "width", resolutions[res].width, NULL };
+    in.items[2] = (map_item_t){ "height", resolutions[res].height, NULL };
+    in.items[3] = (map_item_t){ "src_fmt", 0, format };
+    in.items[4] = (map_item_t){ "mmap", strcmp(io, "mmap") == 0, NULL };
+    in.items[5] = (map_item_t){ "cpu_opt", 0, level };
+    in.items[6] = (map_item_t){ "threads", threads, NULL };
+    in.items[7] = (map_item_t){ "fused_read", strcmp(io, "fused") == 0, NULL };
+    in.items[8] = (map_item_t){ "nt_store", nt_store, NULL };
+    in.num_items = 9;
+
+    memset(&filter, 0, sizeof filter);
+    create_source(&in, &out, NULL, core, &api);
+    if (out.error[0]) {
+        printf("%-10s %-6s %-9s %s\n", format, resolutions[res].name, level, out.error);
+        return;
+    }
+
+    /* the last frame may be read instead of mapped, see rs_get_frame. */
+    int num_frames = filter.node.vi[0].numFrames;
+    if (num_frames > 1) {
+        num_frames--;
+    }
+
+    int count = 0;
+    double start = 0.0, elapsed = 0.0;
+    const char *error = NULL;
+    for (int i = -1; !error && (elapsed < min_time || count < 3); i++) {
+        VSFrameContext ctx = { 0, NULL };
+        void *frame_data = NULL;
+        const VSFrameRef *f = filter.get_frame((i < 0 ? 0 : i) % num_frames, arInitial,
+                                               &filter.instance, &frame_data,
+                                               &ctx, core, &api);
+        free_frame(f);
+        error = ctx.error;
+        if (i < 0) {
+            /* the first frame only warms up the mapping and the frames. */
+            start = get_time();
+            continue;
+        }
+        count++;
+        elapsed = get_time() - start;
+    }
+
+    if (error) {
+        printf("%-10s %-6s %-9s %s\n", format, resolutions[res].name, level, error);
+    } else {
+        double bytes = (double)output_bytes(&filter.node) * count;
+        printf("%-10s %-6s %-9s %8.2f GB/s %9.1f fps\n", format, resolutions[res].name,
+               level, bytes / elapsed / 1e9, count / elapsed);
+    }
+    fflush(stdout);
+
+    filter.free(filter.instance, core, &api);
+    flush_spare_frames();
+}
+
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: bench [-t seconds] [-j threads] [-i io] [-n nt_store] [src_fmt ...]\n"
+            "  -t  minimum time spent on each case (default 0.2)\n"
+            "  -j  threads unpacking each frame (default 1)\n"
+            "  -i  'mmap', 'read' (whole frames) or 'fused' (read while unpacking),\n"
+            "      default 'mmap'\n"
+            "  -n  streaming stores for plane copies, -1 (by frame size), 0 or 1\n"
+            "      (default -1)\n"
+            "  decodes every src_fmt at SD, 1080p, 4K and 8K, the packed ones\n"
+            "  once per cpu_opt level the cpu supports.\n");
+}
+
+
+int main(int argc, char **argv)
+{
+    double min_time = 0.2;
+    int threads = 1;
+    int nt_store = -1;
+    const char *io = "mmap";
+    int first_format = 1;
+
+    for (; first_format + 1 < argc; first_format += 2) {
+        if (strcmp(argv[first_format], "-t") == 0) {
+            min_time = atof(argv[first_format + 1]);
+        } else if (strcmp(argv[first_format], "-j") == 0) {
+            threads = atoi(argv[first_format + 1]);
+        } else if (strcmp(argv[first_format], "-n") == 0) {
+            nt_store = atoi(argv[first_format + 1]);
+        } else if (strcmp(argv[first_format], "-i") == 0) {
+            io = argv[first_format + 1];
+        } else {
+            break;
+        }
+    }
+    if ((first_format < argc && argv[first_format][0] == '-') ||
+        (strcmp(io, "mmap") != 0 && strcmp(io, "read") != 0 && strcmp(io, "fused") != 0)) {
+        usage();
+        return 1;
+    }
+
+    VapourSynthPluginInit(config_plugin, register_function, NULL);
+    if (!create_source) {
+        fprintf(stderr, "bench: Source was not registered\n");
+        return 1;
+    }
+
+    const char *path = create_bench_file();
+    if (!path) {
+        fprintf(stderr, "bench: failed to create the input file\n");
+        return 1;
+    }
+
+    VSCore core = { { "bench", 0, VAPOURSYNTH_API_VERSION, 1, 0, 0 } };
+    int max_level = rs_cpu_level();
+    printf("cpu level: %s\n", rs_cpu_level_name(max_level));
+
+    for (size_t f = 0; f < sizeof source_formats / sizeof source_formats[0]; f++) {
+        const char *format = source_formats[f].name;
+        int selected = first_format == argc;
+        for (int a = first_format; a < argc && !selected; a++) {
+            selected = strcasecmp(argv[a], format) == 0;
+        }
+        if (!selected) {
+            continue;
+        }
+        for (size_t r = 0; r < sizeof resolutions / sizeof resolutions[0]; r++) {
+            if (!source_formats[f].packed) {
+                run_case(path, format, (int)r, "auto", io, threads, nt_store,
+                         min_time, &core);
+                continue;
+            }
+            for (int level = RS_CPU_C; level <= max_level; level++) {
+                run_case(path, format, (int)r, rs_cpu_level_name(level), io, threads,
+                         nt_store, min_time, &core);
+            }
+        }
+    }
+
+    remove(path);
+    return 0;
+}
@@ -0,0 +1,405 @@
+/*
+  check.c: compares the simd kernels of vsrawsource with their c references
+
+  This file is a part of vsrawsource
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with Libav; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+/* every kernel the getters of unpack.h hand out at each cpu level the cpu
+   supports is run on random rows next to the one they hand out at the c
+   level, over every width up to a few vectors, a few large ones, and
+   unaligned sources. the whole destination is compared, guard bytes past
+   the row included, so that a kernel writing too far is caught as well.
+   the 4:2:2 decimation has no simd version and is checked against the
+   definition instead. */
+
+#include "rawsource.h"
+#include "unpack.h"
+
+#define MAX_WIDTH 4160
+#define GUARD_SIZE 64
+#define BUFF_SIZE (MAX_WIDTH * 8 + GUARD_SIZE * 2)
+#define GUARD_BYTE 0xa5
+
+
+static const int widths[] = { 4095, 4096, 4097, 4159 };
+#define NUM_SMALL_WIDTHS 288
+
+static const int src_offsets[] = { 0, 1, 3, 7 };
+
+static const struct {
+    unpack_kind_t kind;
+    const char *name;
+    int src_bytes;      /* per pixel */
+    int num_planes;
+    int dst_bytes;      /* per sample */
+} unpack_kinds[] = {
+    { UNPACK_DEINT2_8,    "deint2_8",    2, 2, 1 },
+    { UNPACK_DEINT2_16,   "deint2_16",   4, 2, 2 },
+    { UNPACK_DEINT3_8,    "deint3_8",    3, 3, 1 },
+    { UNPACK_DEINT3_16,   "deint3_16",   6, 3, 2 },
+    { UNPACK_DEINT4_8,    "deint4_8",    4, 4, 1 },
+    { UNPACK_YUYV,        "yuyv",        2, 3, 1 },
+    { UNPACK_UYVY,        "uyvy",        2, 3, 1 },
+    { UNPACK_SWAP16,      "swap16",      2, 1, 2 },
+    { UNPACK_SWAP32,      "swap32",      4, 1, 4 },
+    { UNPACK_DEINT2_16BE, "deint2_16be", 4, 2, 2 },
+    { UNPACK_DEINT3_16BE, "deint3_16be", 6, 3, 2 },
+};
+
+static const struct {
+    convert_kind_t kind;
+    const char *name;
+    int src_bytes;
+    int dst_bytes;
+} convert_kinds[] = {
+    { CONVERT_U8_U16,  "u8_u16",  1, 2 },
+    { CONVERT_U16_U8,  "u16_u8",  2, 1 },
+    { CONVERT_U16_U16, "u16_u16", 2, 2 },
+    { CONVERT_U8_F32,  "u8_f32",  1, 4 },
+    { CONVERT_U16_F32, "u16_f32", 2, 4 },
+    { CONVERT_U8_F16,  "u8_f16",  1, 2 },
+    { CONVERT_U16_F16, "u16_f16", 2, 2 },
+};
+
+static const int decimate_units[] = { 1, 2, 3, 4, 6, 8 };
+static const int decimate_factors[] = { 2, 4, 8 };
+
+static uint8_t *src_buff;
+static uint8_t *ref_buff;
+static uint8_t *dst_buff;
+static int num_checked;
+static int num_failed;
+
+
+static uint32_t rand_state = 0x12345678;
+
+static uint32_t next_rand(void)
+{
+    /* xorshift32 keeps the runs reproducible across libcs. */
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+
+static void fill_random(uint8_t *p, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        p[i] = (uint8_t)next_rand();
+    }
+}
+
+
+static int width_at(int i)
+{
+    return i < NUM_SMALL_WIDTHS ? i + 1 : widths[i - NUM_SMALL_WIDTHS];
+}
+
+#define NUM_WIDTHS (NUM_SMALL_WIDTHS + (int)(sizeof widths / sizeof widths[0]))
+
+
+static void report(const char *family, const char *name, int level,
+                   int failed_width, int failed_offset)
+{
+    num_checked++;
+    if (failed_width < 0) {
+        printf("  %-8s %-12s %-9s ok\n", family, name, rs_cpu_level_name(level));
+        return;
+    }
+    num_failed++;
+    printf("  %-8s %-12s %-9s FAILED (width %d, source offset %d)\n",
+           family, name, rs_cpu_level_name(level), failed_width, failed_offset);
+}
+
+
+/* the destination planes are laid out one after the other in the buffer,
+   each followed by its guard bytes. */
+static void check_unpack(int k, int level)
+{
+    func_unpack_row ref = rs_get_unpack_row(unpack_kinds[k].kind, RS_CPU_C);
+    func_unpack_row func = rs_get_unpack_row(unpack_kinds[k].kind, level);
+    int plane_size = MAX_WIDTH * unpack_kinds[k].dst_bytes + GUARD_SIZE;
+    size_t buff_size = (size_t)plane_size * unpack_kinds[k].num_planes;
+
+    for (int w = 0; w < NUM_WIDTHS; w++) {
+        int width = width_at(w);
+        for (size_t o = 0; o < sizeof src_offsets / sizeof src_offsets[0]; o++) {
+            uint8_t *srcp = src_buff + src_offsets[o];
+            fill_random(srcp, (size_t)width * unpack_kinds[k].src_bytes + 16);
+
+            uint8_t *ref_planes[4] = { NULL }, *dst_planes[4] = { NULL };
+            for (int p = 0; p < unpack_kinds[k].num_planes; p++) {
+                ref_planes[p] = ref_buff + p * plane_size;
+                dst_planes[p] = dst_buff + p * plane_size;
+            }
+            memset(ref_buff, GUARD_BYTE, buff_size);
+            memset(dst_buff, GUARD_BYTE, buff_size);
+            ref(srcp, ref_planes, width);
+            func(srcp, dst_planes, width);
+            if (memcmp(ref_buff, dst_buff, buff_size) != 0) {
+                report("unpack", unpack_kinds[k].name, level, width, src_offsets[o]);
+                return;
+            }
+        }
+    }
+    report("unpack", unpack_kinds[k].name, level, -1, 0);
+}
+
+
+/* the parameter sets rawsource.c derives for kind: every pair of depths,
+   with and without the chroma bias, and p010's 10 significant bits. sets
+   which convert nothing return 0, and -1 follows the last one. */
+static int convert_params(convert_kind_t kind, int i, rs_convert_t *cv)
+{
+    memset(cv, 0, sizeof *cv);
+    int bits;
+    switch (kind) {
+    case CONVERT_U8_U16:
+        if (i >= 8) {
+            return -1;
+        }
+        cv->shift = i + 1;
+        cv->max = (1 << (9 + i)) - 1;
+        return 1;
+    case CONVERT_U16_U8:
+        if (i >= 8) {
+            return -1;
+        }
+        cv->shift = -(i + 1);
+        cv->max = 255;
+        return 1;
+    case CONVERT_U16_U16:
+        if (i >= 8 * 8) {
+            return -1;
+        }
+        cv->shift = i % 8 - i / 8;
+        cv->max = (1 << (i % 8 + 9)) - 1;
+        return cv->shift != 0;
+    case CONVERT_U8_F32:
+    case CONVERT_U8_F16:
+        if (i >= 2) {
+            return -1;
+        }
+        cv->bias = i ? -128 : 0;
+        cv->scale = 1.0f / 255;
+        return 1;
+    default:
+        if (i >= 2 * 9) {
+            return -1;
+        }
+        bits = i < 16 ? i / 2 + 9 : 16;
+        cv->bias = i & 1 ? -(1 << (bits - 1)) : 0;
+        cv->scale = i < 16 ? 1.0f / ((1 << bits) - 1) : 1.0f / (1023 << 6);
+        return 1;
+    }
+}
+
+
+static void check_convert(int k, int level)
+{
+    convert_kind_t kind = convert_kinds[k].kind;
+    func_convert_row ref = rs_get_convert_row(kind, RS_CPU_C);
+    func_convert_row func = rs_get_convert_row(kind, level);
+    int dst_size = MAX_WIDTH * convert_kinds[k].dst_bytes + GUARD_SIZE;
+
+    rs_convert_t cv;
+    int valid;
+    for (int i = 0; (valid = convert_params(kind, i, &cv)) >= 0; i++) {
+        if (!valid) {
+            continue;
+        }
+        for (int w = 0; w < NUM_WIDTHS; w++) {
+            int width = width_at(w);
+            for (size_t o = 0; o < sizeof src_offsets / sizeof src_offsets[0]; o++) {
+                /* samples of 16 bits stay aligned to them. */
+                int offset = src_offsets[o] & -convert_kinds[k].src_bytes;
+                uint8_t *srcp = src_buff + offset;
+                fill_random(srcp, (size_t)width * convert_kinds[k].src_bytes);
+                memset(ref_buff, GUARD_BYTE, dst_size);
+                memset(dst_buff, GUARD_BYTE, dst_size);
+                ref(srcp, ref_buff, width, &cv);
+                func(srcp, dst_buff, width, &cv);
+                if (memcmp(ref_buff, dst_buff, dst_size) != 0) {
+                    report("convert", convert_kinds[k].name, level, width, offset);
+                    return;
+                }
+            }
+        }
+    }
+    report("convert", convert_kinds[k].name, level, -1, 0);
+}
+
+
+static void check_decimate(int u, int level)
+{
+    int unit = decimate_units[u];
+    func_decimate_row ref = rs_get_decimate_row(unit, RS_CPU_C);
+    func_decimate_row func = rs_get_decimate_row(unit, level);
+    int dst_size = MAX_WIDTH * unit + GUARD_SIZE;
+    char name[16];
+    snprintf(name, sizeof name, "unit %d", unit);
+
+    for (size_t f = 0; f < sizeof decimate_factors / sizeof decimate_factors[0]; f++) {
+        int factor = decimate_factors[f];
+        for (int w = 0; w < NUM_WIDTHS; w++) {
+            int num_units = width_at(w) / factor;
+            if (num_units == 0) {
+                continue;
+            }
+            /* nothing follows the source, the kernels may not read past
+               num_units * unit * factor bytes. */
+            size_t src_size = (size_t)num_units * unit * factor;
+            uint8_t *srcp = (uint8_t *)malloc(src_size);
+            if (!srcp) {
+                report("decimate", name, level, num_units, 0);
+                return;
+            }
+            fill_random(srcp, src_size);
+            memset(ref_buff, GUARD_BYTE, dst_size);
+            memset(dst_buff, GUARD_BYTE, dst_size);
+            ref(srcp, ref_buff, num_units, factor);
+            func(srcp, dst_buff, num_units, factor);
+            free(srcp);
+            if (memcmp(ref_buff, dst_buff, dst_size) != 0) {
+                report("decimate", name, level, num_units, 0);
+                return;
+            }
+        }
+    }
+    report("decimate", name, level, -1, 0);
+}
+
+
+/* pixel 2 * x of the output takes the chroma of pixel 2 * x * factor, and
+   each luma sample n comes from sample n * factor. */
+static void check_decimate_422(int luma)
+{
+    func_decimate_row func = rs_get_decimate_422(luma);
+    int chroma = luma ^ 1;
+
+    for (size_t f = 0; f < sizeof decimate_factors / sizeof decimate_factors[0]; f++) {
+        int factor = decimate_factors[f];
+        for (int w = 0; w < NUM_WIDTHS; w++) {
+            int num_units = width_at(w) / (2 * factor);
+            if (num_units == 0) {
+                continue;
+            }
+            size_t src_size = (size_t)num_units * 4 * factor;
+            fill_random(src_buff, src_size);
+            memset(ref_buff, GUARD_BYTE, MAX_WIDTH * 4 + GUARD_SIZE);
+            memset(dst_buff, GUARD_BYTE, MAX_WIDTH * 4 + GUARD_SIZE);
+            for (int x = 0; x < num_units; x++) {
+                for (int i = 0; i < 2; i++) {
+                    int n = (2 * x + i) * factor;
+                    ref_buff[4 * x + 2 * i + luma] = src_buff[2 * n + luma];
+                    ref_buff[4 * x + 2 * i + chroma] =
+                        src_buff[4 * x * factor + 2 * i + chroma];
+                }
+            }
+            func(src_buff, dst_buff, num_units, factor);
+            if (memcmp(ref_buff, dst_buff, MAX_WIDTH * 4 + GUARD_SIZE) != 0) {
+                report("decimate", luma ? "uyvy" : "yuyv", RS_CPU_C, num_units, 0);
+                return;
+            }
+        }
+    }
+    report("decimate", luma ? "uyvy" : "yuyv", RS_CPU_C, -1, 0);
+}
+
+
+/* rows are copied into a destination of a wider stride, whose bytes between
+   the rows have to be left alone. */
+static void check_stream_copy(int level)
+{
+    func_stream_copy func = rs_get_stream_copy(level);
+    const int height = 3;
+
+    for (int w = 0; w < NUM_WIDTHS; w++) {
+        int row_size = width_at(w);
+        int dst_stride = (row_size + GUARD_SIZE + 63) & ~63;
+        int dst_size = dst_stride * height;
+        for (size_t o = 0; o < sizeof src_offsets / sizeof src_offsets[0]; o++) {
+            int src_stride = row_size + src_offsets[o];
+            uint8_t *srcp = src_buff + src_offsets[o];
+            fill_random(srcp, (size_t)src_stride * height);
+            memset(ref_buff, GUARD_BYTE, dst_size);
+            memset(dst_buff, GUARD_BYTE, dst_size);
+            for (int y = 0; y < height; y++) {
+                memcpy(ref_buff + y * dst_stride, srcp + y * src_stride, row_size);
+            }
+            func(srcp, src_stride, dst_buff, dst_stride, row_size, height);
+            if (memcmp(ref_buff, dst_buff, dst_size) != 0) {
+                report("copy", "stream", level, row_size, src_offsets[o]);
+                return;
+            }
+        }
+    }
+    report("copy", "stream", level, -1, 0);
+}
+
+
+int main(void)
+{
+    rs_unpack_init();
+    int max_level = rs_cpu_level();
+    printf("cpu level: %s\n", rs_cpu_level_name(max_level));
+
+    src_buff = (uint8_t *)rs_aligned_malloc(BUFF_SIZE, 64);
+    ref_buff = (uint8_t *)rs_aligned_malloc(BUFF_SIZE, 64);
+    dst_buff = (uint8_t *)rs_aligned_malloc(BUFF_SIZE, 64);
+    if (!src_buff || !ref_buff || !dst_buff) {
+        fprintf(stderr, "check: failed to allocate buffers\n");
+        return 1;
+    }
+
+    check_decimate_422(0);
+    check_decimate_422(1);
+
+    /* a level only gets checked for the kernels it adds, the others were
+       already compared at the level they come from. */
+    for (int level = RS_CPU_C + 1; level <= max_level; level++) {
+        for (size_t k = 0; k < sizeof unpack_kinds / sizeof unpack_kinds[0]; k++) {
+            unpack_kind_t kind = unpack_kinds[k].kind;
+            if (rs_get_unpack_row(kind, level) != rs_get_unpack_row(kind, level - 1)) {
+                check_unpack((int)k, level);
+            }
+        }
+        for (size_t k = 0; k < sizeof convert_kinds / sizeof convert_kinds[0]; k++) {
+            convert_kind_t kind = convert_kinds[k].kind;
+            if (rs_get_convert_row(kind, level) != rs_get_convert_row(kind, level - 1)) {
+                check_convert((int)k, level);
+            }
+        }
+        for (size_t u = 0; u < sizeof decimate_units / sizeof decimate_units[0]; u++) {
+            int unit = decimate_units[u];
+            if (rs_get_decimate_row(unit, level) != rs_get_decimate_row(unit, level - 1)) {
+                check_decimate((int)u, level);
+            }
+        }
+        if (rs_get_stream_copy(level) != rs_get_stream_copy(level - 1)) {
+            check_stream_copy(level);
+        }
+    }
+
+    rs_aligned_free(src_buff);
+    rs_aligned_free(ref_buff);
+    rs_aligned_free(dst_buff);
+
+    printf("%d kernels checked, %d failed\n", num_checked, num_failed);
+    return num_failed > 0;
+}
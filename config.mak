@@ -0,0 +1,6 @@
+CC = gcc
+LD = gcc
+STRIP = strip
+LIBNAME = libvsrawsource.so
+CFLAGS = -msse2 -mfpmath=sse -Os -g0 -ffast-math -fomit-frame-pointer -Wshadow -Wall -std=gnu99 -I. -fPIC  -fexcess-precision=fast -DHAVE_IO_URING -DHAVE_INOTIFY
+LDFLAGS = -shared -fPIC -L. -lpthread 
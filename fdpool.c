@@ -0,0 +1,299 @@
+/*
+  fdpool.c: shared pool of open files for vsrawsource
+
+  This file is a part of vsrawsource
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with Libav; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "rawsource.h"
+#include "fdpool.h"
+
+#define FD_POOL_BUCKETS 1024
+
+/* an entry exists while its file is open. entries nobody has acquired are
+   also linked into the idle list, most recently released first. */
+struct rs_fd_entry {
+    char *path;
+    uint64_t hash;
+    rs_fd_t fd;
+    int users;
+    rs_fd_entry_t *chain;
+    rs_fd_entry_t *prev;
+    rs_fd_entry_t *next;
+};
+
+struct rs_fd_pool {
+    rs_mutex_t mutex;
+    const void *owner;
+    int refs;
+    rs_fd_pool_t *next_pool;
+    int capacity;
+    int num_open;
+    int64_t opens;
+    int64_t evictions;
+    int64_t hits;
+    rs_fd_entry_t *idle_head;
+    rs_fd_entry_t *idle_tail;
+    rs_fd_entry_t *buckets[FD_POOL_BUCKETS];
+};
+
+
+static rs_mutex_t pools_mutex;
+static rs_fd_pool_t *pools;
+
+#ifdef _WIN32
+static INIT_ONCE pools_once = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK init_pools(PINIT_ONCE once, PVOID param, PVOID *context)
+{
+    rs_mutex_init(&pools_mutex);
+    return TRUE;
+}
+#else
+static pthread_once_t pools_once = PTHREAD_ONCE_INIT;
+
+static void init_pools(void)
+{
+    rs_mutex_init(&pools_mutex);
+}
+#endif
+
+
+static uint64_t hash_path(const char *path)
+{
+    /* FNV-1a */
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const uint8_t *p = (const uint8_t *)path; *p; p++) {
+        hash = (hash ^ *p) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+
+static rs_fd_entry_t **find_entry(rs_fd_pool_t *pool, const char *path,
+                                  uint64_t hash)
+{
+    rs_fd_entry_t **link = pool->buckets + hash % FD_POOL_BUCKETS;
+    while (*link && ((*link)->hash != hash || strcmp((*link)->path, path) != 0)) {
+        link = &(*link)->chain;
+    }
+    return link;
+}
+
+
+static void idle_unlink(rs_fd_pool_t *pool, rs_fd_entry_t *e)
+{
+    if (e->prev) {
+        e->prev->next = e->next;
+    } else {
+        pool->idle_head = e->next;
+    }
+    if (e->next) {
+        e->next->prev = e->prev;
+    } else {
+        pool->idle_tail = e->prev;
+    }
+    e->prev = e->next = NULL;
+}
+
+
+static void idle_push(rs_fd_pool_t *pool, rs_fd_entry_t *e)
+{
+    e->prev = NULL;
+    e->next = pool->idle_head;
+    if (pool->idle_head) {
+        pool->idle_head->prev = e;
+    } else {
+        pool->idle_tail = e;
+    }
+    pool->idle_head = e;
+}
+
+
+static void free_entry(rs_fd_entry_t *e)
+{
+    rs_close(e->fd);
+    free(e->path);
+    free(e);
+}
+
+
+static void evict_idle(rs_fd_pool_t *pool)
+{
+    while (pool->num_open > pool->capacity && pool->idle_tail) {
+        rs_fd_entry_t *e = pool->idle_tail;
+        idle_unlink(pool, e);
+        *find_entry(pool, e->path, e->hash) = e->chain;
+        free_entry(e);
+        pool->num_open--;
+        pool->evictions++;
+    }
+}
+
+
+rs_fd_pool_t *rs_fd_pool_get(const void *owner, int capacity)
+{
+#ifdef _WIN32
+    InitOnceExecuteOnce(&pools_once, init_pools, NULL, NULL);
+#else
+    pthread_once(&pools_once, init_pools);
+#endif
+
+    rs_mutex_lock(&pools_mutex);
+    rs_fd_pool_t *pool = pools;
+    while (pool && pool->owner != owner) {
+        pool = pool->next_pool;
+    }
+    if (pool) {
+        rs_mutex_lock(&pool->mutex);
+        pool->refs++;
+        if (pool->capacity < capacity) {
+            pool->capacity = capacity;
+        }
+        rs_mutex_unlock(&pool->mutex);
+    } else {
+        pool = (rs_fd_pool_t *)calloc(1, sizeof(rs_fd_pool_t));
+        if (pool) {
+            rs_mutex_init(&pool->mutex);
+            pool->owner = owner;
+            pool->refs = 1;
+            pool->capacity = capacity;
+            pool->next_pool = pools;
+            pools = pool;
+        }
+    }
+    rs_mutex_unlock(&pools_mutex);
+    return pool;
+}
+
+
+void rs_fd_pool_put(rs_fd_pool_t *pool)
+{
+    if (!pool) {
+        return;
+    }
+
+    rs_mutex_lock(&pools_mutex);
+    if (--pool->refs > 0) {
+        rs_mutex_unlock(&pools_mutex);
+        return;
+    }
+    rs_fd_pool_t **link = &pools;
+    while (*link != pool) {
+        link = &(*link)->next_pool;
+    }
+    *link = pool->next_pool;
+    rs_mutex_unlock(&pools_mutex);
+
+    for (int i = 0; i < FD_POOL_BUCKETS; i++) {
+        rs_fd_entry_t *e = pool->buckets[i];
+        while (e) {
+            rs_fd_entry_t *chain = e->chain;
+            free_entry(e);
+            e = chain;
+        }
+    }
+    rs_mutex_destroy(&pool->mutex);
+    free(pool);
+}
+
+
+/* the file is opened without holding the lock, so a slow open does not
+   stall the reads of other files. when two requests race to open the
+   same file, the loser closes its descriptor again. */
+rs_fd_entry_t *rs_fd_pool_acquire(rs_fd_pool_t *pool, const char *path,
+                                  rs_fd_t *fd)
+{
+    uint64_t hash = hash_path(path);
+
+    rs_mutex_lock(&pool->mutex);
+    rs_fd_entry_t *e = *find_entry(pool, path, hash);
+    if (e) {
+        if (e->users++ == 0) {
+            idle_unlink(pool, e);
+        }
+        pool->hits++;
+        *fd = e->fd;
+        rs_mutex_unlock(&pool->mutex);
+        return e;
+    }
+    rs_mutex_unlock(&pool->mutex);
+
+    rs_fd_entry_t *created = (rs_fd_entry_t *)calloc(1, sizeof(rs_fd_entry_t));
+    if (!created) {
+        return NULL;
+    }
+    created->path = (char *)malloc(strlen(path) + 1);
+    created->fd = rs_open(path, 0);
+    if (!created->path || created->fd == RS_INVALID_FD) {
+        if (created->fd != RS_INVALID_FD) {
+            rs_close(created->fd);
+        }
+        free(created->path);
+        free(created);
+        return NULL;
+    }
+    strcpy(created->path, path);
+    created->hash = hash;
+    created->users = 1;
+
+    rs_mutex_lock(&pool->mutex);
+    rs_fd_entry_t **link = find_entry(pool, path, hash);
+    e = *link;
+    if (e) {
+        if (e->users++ == 0) {
+            idle_unlink(pool, e);
+        }
+        pool->hits++;
+    } else {
+        e = *link = created;
+        created = NULL;
+        pool->num_open++;
+        pool->opens++;
+        evict_idle(pool);
+    }
+    *fd = e->fd;
+    rs_mutex_unlock(&pool->mutex);
+
+    if (created) {
+        free_entry(created);
+    }
+    return e;
+}
+
+
+void rs_fd_pool_release(rs_fd_pool_t *pool, rs_fd_entry_t *entry)
+{
+    rs_mutex_lock(&pool->mutex);
+    if (--entry->users == 0) {
+        idle_push(pool, entry);
+        evict_idle(pool);
+    }
+    rs_mutex_unlock(&pool->mutex);
+}
+
+
+void rs_fd_pool_stats(rs_fd_pool_t *pool, rs_fd_pool_stats_t *stats)
+{
+    rs_mutex_lock(&pool->mutex);
+    stats->capacity = pool->capacity;
+    stats->num_open = pool->num_open;
+    stats->opens = pool->opens;
+    stats->evictions = pool->evictions;
+    stats->hits = pool->hits;
+    rs_mutex_unlock(&pool->mutex);
+}
@@ -0,0 +1,59 @@
+/*
+  fdpool.h: shared pool of open files for vsrawsource
+
+  This file is a part of vsrawsource
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with Libav; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#ifndef VS_RAW_SOURCE_FDPOOL_H
+#define VS_RAW_SOURCE_FDPOOL_H
+
+#include "rawsource.h"
+
+typedef struct rs_fd_pool rs_fd_pool_t;
+typedef struct rs_fd_entry rs_fd_entry_t;
+
+typedef struct {
+    int capacity;
+    int num_open;
+    int64_t opens;
+    int64_t evictions;
+    int64_t hits;
+} rs_fd_pool_stats_t;
+
+/* returns the pool shared by every source created with the same owner
+   (the core), creating it on first use. a later caller asking for a
+   larger capacity raises it. NULL if allocation failed. */
+rs_fd_pool_t *rs_fd_pool_get(const void *owner, int capacity);
+
+/* drops one reference, the last one closes every file of the pool. */
+void rs_fd_pool_put(rs_fd_pool_t *pool);
+
+/* returns the entry holding path open and stores its descriptor in *fd.
+   the descriptor is only valid until the entry is released and must be
+   read with positional reads, since other requests share it. NULL if the
+   file could not be opened. */
+rs_fd_entry_t *rs_fd_pool_acquire(rs_fd_pool_t *pool, const char *path,
+                                  rs_fd_t *fd);
+
+/* files which are not acquired by anyone are kept open up to the capacity,
+   the least recently released one is closed first. */
+void rs_fd_pool_release(rs_fd_pool_t *pool, rs_fd_entry_t *entry);
+
+void rs_fd_pool_stats(rs_fd_pool_t *pool, rs_fd_pool_stats_t *stats);
+
+#endif /* VS_RAW_SOURCE_FDPOOL_H */
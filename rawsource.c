@@ -24,31 +24,251 @@
 
 
 #include "rawsource.h"
+#include "uring.h"
+#include "unpack.h"
+#include "fdpool.h"
+#include "workers.h"
 #include "VapourSynth.h"
 
 #define FORMAT_MAX_LEN 32
+#define FRAME_PADDING 32
+#define BUFF_ALIGNMENT 64
+#define DIRECT_IO_ALIGNMENT 4096
+#define URING_CHUNK_SIZE (4 << 20)
+#define URING_MAX_ENTRIES 4096
+#define Y4M_SCAN_BLOCK (4 << 20)
+#define Y4M_MAX_FRAME_HEADER 4096
+#define SEQ_MAX_OPEN 64
+#define FOLLOW_POLL_MS 20
+#define FOLLOW_NOTIFY_MS 100
+#define INDEX_MAGIC "RSIDX002"
+#define INDEX_SUFFIX ".rsidx"
+#define INDEX_SAMPLES 64
+#define MAX_REGIONS 5
+#define BAND_SIZE (256 << 10)
+#define FUSED_MIN_SIZE (2 << 20)
+#define STREAM_MIN_SIZE (32 << 20)
+#define STREAM_MIN_ROW 1024
+#define SPARSE_MIN_GAP 4096
+
+
+typedef struct {
+    rs_mutex_t mutex;
+    size_t size;
+    size_t alignment;
+    void *free_list;
+} buff_pool_t;
+
+
+enum {
+    PF_EMPTY,
+    PF_LOADING,
+    PF_READY,
+    PF_FAILED
+};
+
+typedef struct {
+    int frame;
+    int state;
+    int users;
+    int pending;
+    int failed;
+    uint8_t *buff;
+    const uint8_t *srcp;
+} pf_slot_t;
+
+typedef struct {
+    rs_mutex_t mutex;
+    rs_cond_t cond;
+    rs_thread_t thread;
+    int running;
+    int window;
+    int num_slots;
+    int active;
+    int last_frame;
+    int64_t hits;
+    int64_t misses;
+    pf_slot_t *slots;
+    rs_uring_t *ring;
+    unsigned max_chunks;
+} prefetcher_t;
+
+typedef struct {
+    int frame;
+    int prev;
+    int next;
+    const VSFrameRef *frames[2];
+} cache_entry_t;
+
+typedef struct {
+    rs_mutex_t mutex;
+    const VSAPI *vsapi;
+    int num_outputs;
+    int capacity;
+    int count;
+    int head;
+    int tail;
+    int *lookup;
+    cache_entry_t *entries;
+} frame_cache_t;
+
+typedef struct {
+    int frame;
+    int decoding;
+    unsigned pending;
+    int64_t seq;
+    const VSFrameRef *frames[2];
+} sibling_t;
+
+typedef struct {
+    rs_mutex_t mutex;
+    rs_cond_t cond;
+    const VSAPI *vsapi;
+    int num_entries;
+    int64_t seq;
+    sibling_t *entries;
+} sibling_set_t;
+
+typedef struct {
+    int frame;
+    const VSFrameRef *frames[2];
+} stream_slot_t;
+
+typedef struct {
+    rs_mutex_t mutex;
+    const VSAPI *vsapi;
+    uint8_t *buff;
+    size_t capacity;
+    size_t pos;
+    size_t len;
+    int eof;
+    int next;
+    int window;
+    stream_slot_t *slots;
+} stream_t;
+
+typedef struct {
+    rs_mutex_t mutex;
+    int timeout;
+    int notify_fd;
+    int64_t file_size;
+    int num_indexed;
+    int capacity;
+    int64_t scan_pos;
+    int64_t *index;
+} follower_t;
+
+typedef struct {
+    char *path;
+    int first_frame;
+    int num_frames;
+    int64_t data_offset;
+} segment_t;
+
+typedef struct {
+    rs_mutex_t mutex;
+    rs_fd_pool_t *files;
+    int is_bmp;
+    int num_segments;
+    int capacity;
+    segment_t *segments;
+} sequence_t;
+
+
+/* one block of rows moving from offset in the source frame into
+   destination planes. with unpack NULL the rows are copied and width
+   counts bytes, otherwise width counts pixels for the row kernel.
+   row_size is the number of source bytes used from each row, which is
+   less than src_stride when the frame is cropped. with decimate the rows
+   are first cut down to num_units units, one in factor, straight into the
+   destination when copied or into a scratch row for the kernel. with
+   convert the copied or unpacked samples are converted on their way into
+   the destination, conv_width of them for each of its planes. */
+typedef struct {
+    size_t offset;
+    int src_stride;
+    int row_size;
+    int width;
+    int height;
+    func_unpack_row unpack;
+    func_stream_copy stream_copy;
+    func_decimate_row decimate;
+    int num_units;
+    int factor;
+    func_convert_row convert;
+    int tmp_stride;
+    int num_dst;
+    uint8_t *dstp[4];
+    int dst_stride[4];
+    int conv_width[4];
+    rs_convert_t cv[4];
+} region_t;
 
 
 typedef struct rs_hndle rs_hnd_t;
-typedef void (VS_CC *func_write_frame)(rs_hnd_t *, VSFrameRef **, const VSAPI *,
-                                       VSCore *);
+/* stores the regions of one frame, allocating dst[1] for the alpha
+   formats, and returns how many there are. */
+typedef int (VS_CC *func_layout_frame)(const rs_hnd_t *, VSFrameRef **,
+                                       region_t *, const VSAPI *, VSCore *);
 
 struct rs_hndle {
-    FILE *file;
+    rs_fd_t fd;
     int64_t file_size;
+    int direct_io;
+    uint8_t *map;
+#ifdef _WIN32
+    HANDLE map_hnd;
+#endif
+    buff_pool_t pool;
+    buff_pool_t chunks;
+    buff_pool_t scratch;
+    prefetcher_t *pf;
+    frame_cache_t *cache;
+    sibling_set_t *siblings;
+    stream_t *stream;
+    follower_t *follow;
+    sequence_t *seq;
+    rs_workers_t *workers;
     uint32_t frame_size;
     char src_format[FORMAT_MAX_LEN];
     int order[4];
     int off_header;
     int off_frame;
+    int is_y4m;
+    int fused_read;
     int sar_num;
     int sar_den;
     int row_adjust;
+    int src_width;
+    int src_height;
+    int crop_left;
+    int crop_top;
+    int plane_mask;
+    int proxy;
+    int unpack_unit;
     int has_alpha;
+    int num_src_planes;
+    uint32_t plane_offset[4];
+    int64_t mtime;
     int64_t *index;
+    void *index_map;
+    size_t index_map_size;
     uint64_t *total_pix;
-    uint8_t *frame_buff;
-    func_write_frame write_frame;
+    func_layout_frame layout_frame;
+    unpack_kind_t unpack_kind;
+    func_unpack_row unpack_row;
+    unpack_kind_t swap_kind;
+    func_unpack_row swap_row;
+    func_stream_copy stream_copy;
+    func_decimate_row copy_decimate;
+    func_decimate_row unpack_decimate;
+    convert_kind_t convert_kind;
+    func_convert_row convert_row;
+    rs_convert_t convert;
+    int chroma_bias;
+    int significant_bits;
+    int tmp_stride;
+    const VSFormat *src_fi;
     VSVideoInfo vi[2];
 };
 
@@ -62,323 +282,2241 @@ typedef struct {
 } vs_args_t;
 
 
+static void pool_init(buff_pool_t *pool)
+{
+    rs_mutex_init(&pool->mutex);
+    pool->size = 0;
+    pool->alignment = BUFF_ALIGNMENT;
+    pool->free_list = NULL;
+}
+
+
+static void pool_destroy(buff_pool_t *pool)
+{
+    while (pool->free_list) {
+        void *buff = pool->free_list;
+        pool->free_list = *(void **)buff;
+        rs_aligned_free(buff);
+    }
+    rs_mutex_destroy(&pool->mutex);
+}
+
+
+/* buffers are recycled through a free list threaded through the unused
+   buffers themselves, so the pool only ever grows to the number of frames
+   which are being read at the same time. */
+static uint8_t *pool_get(buff_pool_t *pool)
+{
+    rs_mutex_lock(&pool->mutex);
+    void *buff = pool->free_list;
+    if (buff) {
+        pool->free_list = *(void **)buff;
+    }
+    rs_mutex_unlock(&pool->mutex);
+
+    if (!buff) {
+        buff = rs_aligned_malloc(pool->size, pool->alignment);
+    }
+    return (uint8_t *)buff;
+}
+
+
+static void pool_release(buff_pool_t *pool, uint8_t *buff)
+{
+    if (!buff) {
+        return;
+    }
+    rs_mutex_lock(&pool->mutex);
+    *(void **)buff = pool->free_list;
+    pool->free_list = buff;
+    rs_mutex_unlock(&pool->mutex);
+}
+
+
+static rs_fd_t rs_open_stdin(void)
+{
+#ifdef _WIN32
+    HANDLE hnd;
+    if (!DuplicateHandle(GetCurrentProcess(), GetStdHandle(STD_INPUT_HANDLE),
+                         GetCurrentProcess(), &hnd, 0, FALSE,
+                         DUPLICATE_SAME_ACCESS)) {
+        return RS_INVALID_FD;
+    }
+    return hnd;
+#else
+    return dup(STDIN_FILENO);
+#endif
+}
+
+
+/* sequential read for the stream sources. returns 0 at the end of the
+   stream and -1 on errors. */
+static int64_t rs_read(rs_fd_t fd, void *buff, size_t size)
+{
+#ifdef _WIN32
+    DWORD read_size;
+    if (!ReadFile(fd, buff, (DWORD)size, &read_size, NULL)) {
+        return GetLastError() == ERROR_BROKEN_PIPE ? 0 : -1;
+    }
+    return read_size;
+#else
+    ssize_t r;
+    do {
+        r = read(fd, buff, size);
+    } while (r < 0 && errno == EINTR);
+    return r;
+#endif
+}
+
+
+static const char *open_stream(rs_hnd_t *rh)
+{
+    if (rh->fd == RS_INVALID_FD) {
+        return "failed to open source stream";
+    }
+    stream_t *st = (stream_t *)calloc(1, sizeof(stream_t));
+    if (!st) {
+        return "failed to allocate stream";
+    }
+    st->capacity = Y4M_MAX_FRAME_HEADER;
+    st->buff = (uint8_t *)malloc(st->capacity + FRAME_PADDING);
+    if (!st->buff) {
+        free(st);
+        return "failed to allocate stream";
+    }
+    rs_mutex_init(&st->mutex);
+    rh->stream = st;
+    return NULL;
+}
+
+
+/* "-" is stdin. pipes, FIFOs, character devices and sockets are read as
+   streams as well, anything else (directories, block devices) is refused. */
 static const char *open_source_file(rs_hnd_t *rh, const char *src_name)
 {
+    if (strcmp(src_name, "-") == 0) {
+        rh->fd = rs_open_stdin();
+        return open_stream(rh);
+    }
+
 #ifdef _WIN32
     struct _stat64 st;
     wchar_t tmp[FILENAME_MAX * 4];
     MultiByteToWideChar(CP_UTF8, 0, src_name, -1, tmp, FILENAME_MAX * 4);
 
     if (_wstat64(tmp, &st) != 0) {
+        rh->fd = rs_open(src_name, 0);
+        if (rh->fd != RS_INVALID_FD && GetFileType(rh->fd) == FILE_TYPE_PIPE) {
+            return open_stream(rh);
+        }
+        return "source does not exist.";
+    }
+    if (!(st.st_mode & _S_IFREG)) {
+        return "source is not a regular file or pipe";
+    }
 #else
     struct stat st;
 
     if (stat(src_name, &st) != 0) {
-#endif
-    return "source does not exist.";
+        return "source does not exist.";
+    }
+    if (S_ISFIFO(st.st_mode) || S_ISCHR(st.st_mode) || S_ISSOCK(st.st_mode)) {
+        rh->fd = rs_open(src_name, 0);
+        if (rh->fd == RS_INVALID_FD) {
+            return "failed to open source file";
+        }
+        return open_stream(rh);
     }
+    if (!S_ISREG(st.st_mode)) {
+        return "source is not a regular file or pipe";
+    }
+#endif
 
     if (st.st_size == 0) {
         return "failed to get file size.";
     }
     rh->file_size = st.st_size;
+    rh->fd = rs_open(src_name, 0);
+    if (rh->fd == RS_INVALID_FD) {
+        return "failed to open source file";
+    }
+
+    /* the sidecar index compares mtime at full resolution, as a file
+       rewritten within the same second is not unusual. */
 #ifdef _WIN32
-    rh->file = _wfopen(tmp, L"rb");
+    FILETIME ft;
+    if (GetFileTime(rh->fd, NULL, NULL, &ft)) {
+        rh->mtime = (int64_t)((uint64_t)ft.dwHighDateTime << 32 | ft.dwLowDateTime);
+    } else {
+        rh->mtime = (int64_t)st.st_mtime * 10000000;
+    }
+#elif defined(__APPLE__)
+    rh->mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
 #else
-    rh->file = fopen(src_name, "rb");
+    rh->mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
 #endif
-    if (!rh->file) {
-        return "failed to open source file";
-    }
 
     return NULL;
 }
 
 
-static void VS_CC
-rs_bit_blt(uint8_t *srcp, int row_size, int height, VSFrameRef *dst, int plane,
-           const VSAPI *vsapi)
+static const char *map_source_file(rs_hnd_t *rh, const char *advice)
 {
-    uint8_t *dstp = vsapi->getWritePtr(dst, plane);
-    int dst_stride = vsapi->getStride(dst, plane);
+    if ((uint64_t)rh->file_size > SIZE_MAX) {
+        return "source file is too large to be mapped";
+    }
+
+#ifdef _WIN32
+    rh->map_hnd = CreateFileMapping(rh->fd, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!rh->map_hnd) {
+        return "failed to map source file";
+    }
+    rh->map = (uint8_t *)MapViewOfFile(rh->map_hnd, FILE_MAP_READ, 0, 0, 0);
+    if (!rh->map) {
+        return "failed to map source file";
+    }
+#else
+    const struct {
+        const char *name;
+        int advice;
+    } table[] = {
+        { "normal",     MADV_NORMAL     },
+        { "sequential", MADV_SEQUENTIAL },
+        { "random",     MADV_RANDOM     },
+        { advice,       -1              }
+    };
+
+    int i = 0;
+    while (strcasecmp(advice, table[i].name) != 0) i++;
+    if (table[i].advice < 0) {
+        return "invalid mmap_advice was specified";
+    }
+
+    void *map = mmap(NULL, (size_t)rh->file_size, PROT_READ, MAP_SHARED,
+                     rh->fd, 0);
+    if (map == MAP_FAILED) {
+        return "failed to map source file";
+    }
+    rh->map = (uint8_t *)map;
+    madvise(map, (size_t)rh->file_size, table[i].advice);
+#endif
 
-    if (row_size == dst_stride) {
-        memcpy(dstp, srcp, row_size * height);
+    return NULL;
+}
+
+
+static void close_source_file(rs_hnd_t *rh)
+{
+    if (rh->map) {
+#ifdef _WIN32
+        UnmapViewOfFile(rh->map);
+#else
+        munmap(rh->map, (size_t)rh->file_size);
+#endif
+        rh->map = NULL;
+    }
+#ifdef _WIN32
+    if (rh->map_hnd) {
+        CloseHandle(rh->map_hnd);
+        rh->map_hnd = NULL;
+    }
+#endif
+    if (rh->fd == RS_INVALID_FD) {
         return;
     }
+#ifdef _WIN32
+    CloseHandle(rh->fd);
+#else
+    close(rh->fd);
+#endif
+    rh->fd = RS_INVALID_FD;
+}
+
+
+/* positional read: never touches a shared file offset, so it is safe to call
+   from concurrent frame requests. returns the number of bytes read or -1. */
+static int64_t rs_pread(rs_fd_t fd, void *buff, size_t size, int64_t offset)
+{
+#ifdef _WIN32
+    OVERLAPPED ov = { 0 };
+    DWORD read_size;
+    ov.Offset = (DWORD)offset;
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+    if (!ReadFile(fd, buff, (DWORD)size, &read_size, &ov)) {
+        return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+    }
+    return read_size;
+#else
+    size_t done = 0;
+    while (done < size) {
+        ssize_t r = pread(fd, (uint8_t *)buff + done, size - done,
+                          (off_t)(offset + done));
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (r == 0) {
+            break;
+        }
+        done += r;
+    }
+    return done;
+#endif
+}
+
+
+/* reads height rows of row_size bytes, src_stride apart in the file from
+   offset, straight into rows dst_stride apart. the bytes between the rows,
+   which a crop leaves out, go into skip. up to IOV_MAX iovecs go into one
+   preadv. returns -1 if the file ended before the last row. */
+static int
+rs_pread_rows(rs_fd_t fd, int64_t offset, int src_stride, int row_size,
+              int height, uint8_t *dstp, int dst_stride, uint8_t *skip)
+{
+    if (row_size == src_stride && row_size == dst_stride) {
+        size_t size = (size_t)row_size * height;
+        return rs_pread(fd, dstp, size, offset) == (int64_t)size ? 0 : -1;
+    }
 
+#ifdef _WIN32
     for (int i = 0; i < height; i++) {
-        memcpy(dstp, srcp, row_size);
+        if (rs_pread(fd, dstp, row_size, offset) != row_size) {
+            return -1;
+        }
         dstp += dst_stride;
-        srcp += row_size;
+        offset += src_stride;
+    }
+#else
+    struct iovec iov[IOV_MAX];
+    int gap = src_stride - row_size;
+    int max_rows = gap > 0 ? IOV_MAX / 2 : IOV_MAX;
+    while (height > 0) {
+        int rows = height < max_rows ? height : max_rows;
+        int num = 0;
+        for (int i = 0; i < rows; i++) {
+            iov[num].iov_base = dstp + (size_t)i * dst_stride;
+            iov[num++].iov_len = row_size;
+            if (gap > 0 && i < rows - 1) {
+                iov[num].iov_base = skip;
+                iov[num++].iov_len = gap;
+            }
+        }
+        ssize_t r = preadv(fd, iov, num, (off_t)offset);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return -1;
+        }
+        /* after a short read the row it stopped in is completed alone. */
+        int done = (int)(r / src_stride);
+        int part = (int)(r % src_stride);
+        if (part > 0) {
+            if (part < row_size) {
+                uint8_t *rest = dstp + (size_t)done * dst_stride + part;
+                int64_t size = row_size - part;
+                if (rs_pread(fd, rest, size, offset + r) != size) {
+                    return -1;
+                }
+            }
+            done++;
+        }
+        dstp += (size_t)done * dst_stride;
+        offset += (int64_t)done * src_stride;
+        height -= done;
     }
+#endif
+    return 0;
 }
 
 
-static inline uint32_t VS_CC
-bitor8to32(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3)
+/* makes want bytes of a stream available at st->buff + st->pos unless the
+   stream ends first, and returns how many are. only the missing bytes are
+   read, so that frame data goes from the pipe to the buffer exactly once. */
+static size_t stream_fill(stream_t *st, rs_fd_t fd, size_t want)
 {
-    return ((uint32_t)b0 << 24) | ((uint32_t)b1 << 16) |
-           ((uint32_t)b2 << 8) | (uint32_t)b3;
+    size_t avail = st->len - st->pos;
+    if (avail >= want || st->eof) {
+        return avail;
+    }
+    if (st->pos + want > st->capacity) {
+        memmove(st->buff, st->buff + st->pos, avail);
+        st->pos = 0;
+        st->len = avail;
+    }
+    while (st->len - st->pos < want) {
+        int64_t r = rs_read(fd, st->buff + st->len, st->pos + want - st->len);
+        if (r <= 0) {
+            st->eof = 1;
+            break;
+        }
+        st->len += r;
+    }
+    return st->len - st->pos;
 }
 
 
-static void VS_CC
-write_planar_frame(rs_hnd_t *rh, VSFrameRef **dst, const VSAPI *vsapi,
-                   VSCore *core)
+static void stream_consume(stream_t *st, size_t size)
 {
-    uint8_t *srcp = rh->frame_buff;
-    int bps = rh->vi[0].format->bytesPerSample;
-    int row_size, height;
+    st->pos += size;
+    if (st->pos == st->len) {
+        st->pos = st->len = 0;
+    }
+}
 
-    for (int i = 0, num = rh->vi[0].format->numPlanes; i < num; i++) {
-        int plane = rh->order[i];
-        row_size = vsapi->getFrameWidth(dst[0], plane) * bps;
-        row_size = (row_size + rh->row_adjust) & (~rh->row_adjust);
-        height = vsapi->getFrameHeight(dst[0], plane);
-        rs_bit_blt(srcp, row_size, height, dst[0], plane, vsapi);
-        srcp += row_size * height;
+
+static void stream_skip(stream_t *st, rs_fd_t fd, int64_t size)
+{
+    while (size > 0) {
+        size_t want = size < (int64_t)st->capacity ? (size_t)size : st->capacity;
+        size_t avail = stream_fill(st, fd, want);
+        if (avail == 0) {
+            return;
+        }
+        if (avail > want) {
+            avail = want;
+        }
+        stream_consume(st, avail);
+        size -= avail;
     }
+}
 
-    if (rh->has_alpha == 0) {
-        return;
+
+/* the format probes read through here. a stream serves them from its
+   buffer without consuming anything. */
+static int64_t read_header(const rs_hnd_t *rh, void *buff, size_t size,
+                           int64_t offset)
+{
+    stream_t *st = rh->stream;
+    if (!st) {
+        return rs_pread(rh->fd, buff, size, offset);
+    }
+    size_t avail = stream_fill(st, rh->fd, (size_t)offset + size);
+    if (avail <= (size_t)offset) {
+        return 0;
     }
+    if (size > avail - offset) {
+        size = avail - offset;
+    }
+    memcpy(buff, st->buff + st->pos + offset, size);
+    return size;
+}
 
-    dst[1] = vsapi->newVideoFrame(rh->vi[1].format, rh->vi[1].width,
-                                  rh->vi[1].height, NULL, core);
-    row_size = vsapi->getFrameWidth(dst[1], 0) * bps;
-    row_size = (row_size + rh->row_adjust) & (~rh->row_adjust);
-    height = vsapi->getFrameHeight(dst[1], 0);
-    rs_bit_blt(srcp, row_size, height, dst[1], 0, vsapi);
+
+/* reads the aligned extent covering the frame at pos through a descriptor
+   opened for direct I/O and returns where the frame starts in buff. */
+static const uint8_t *
+read_frame_direct(const rs_hnd_t *rh, int64_t pos, uint8_t *buff)
+{
+    int64_t start = pos & ~(int64_t)(DIRECT_IO_ALIGNMENT - 1);
+    int64_t end = (pos + rh->frame_size + DIRECT_IO_ALIGNMENT - 1)
+                  & ~(int64_t)(DIRECT_IO_ALIGNMENT - 1);
+    size_t size = (size_t)(end - start);
+    int64_t done;
+
+#ifdef _WIN32
+    done = rs_pread(rh->fd, buff, size, start);
+#else
+    /* no retry after a short read: that only happens at the end of the file,
+       and a second request from the unaligned position would be rejected. */
+    do {
+        done = pread(rh->fd, buff, size, (off_t)start);
+    } while (done < 0 && errno == EINTR);
+#endif
+    if (done < pos - start + rh->frame_size) {
+        return NULL;
+    }
+    return buff + (pos - start);
 }
 
 
-static void VS_CC
-write_nvxx_frame(rs_hnd_t *rh, VSFrameRef **dst, const VSAPI *vsapi,
-                 VSCore *core)
+static const uint8_t *read_frame(const rs_hnd_t *rh, int64_t pos, uint8_t *buff)
 {
-    struct uv_t {
-        uint8_t c[8];
-    };
+    if (rh->direct_io) {
+        return read_frame_direct(rh, pos, buff);
+    }
+    if (rs_pread(rh->fd, buff, rh->frame_size, pos) < rh->frame_size) {
+        return NULL;
+    }
+    return buff;
+}
+
+
+static int pf_find_slot(const prefetcher_t *pf, int frame)
+{
+    for (int i = 0; i < pf->num_slots; i++) {
+        if (pf->slots[i].frame == frame && pf->slots[i].state != PF_EMPTY) {
+            return i;
+        }
+    }
+    return -1;
+}
 
-    uint8_t *srcp_orig = rh->frame_buff;
 
-    int row_size = vsapi->getFrameWidth(dst[0], 0);
-    row_size = (row_size + rh->row_adjust) & (~rh->row_adjust);
-    int height = vsapi->getFrameHeight(dst[0], 0);
-    rs_bit_blt(srcp_orig, row_size, height, dst[0], 0, vsapi);
+/* picks the next frame of the read-ahead window which is not held yet, and
+   a slot to read it into. slots holding frames outside of the window can be
+   reused as soon as no request is unpacking from them. the most recently
+   requested frame is kept as well, for the second output of alpha formats. */
+static pf_slot_t *pf_next_job(prefetcher_t *pf, int num_frames, int *frame)
+{
+    if (!pf->active) {
+        return NULL;
+    }
 
-    srcp_orig += row_size * height;
-    int src_stride = row_size;
-    row_size = (vsapi->getFrameWidth(dst[0], 1) + 3) >> 2;
-    height = vsapi->getFrameHeight(dst[0], 1);
+    int first = pf->last_frame + 1;
+    int last = pf->last_frame + pf->window;
+    if (last >= num_frames) {
+        last = num_frames - 1;
+    }
 
-    int dst_stride = vsapi->getStride(dst[0], 1);
-    uint8_t *dstp0_orig = vsapi->getWritePtr(dst[0], rh->order[1]);
-    uint8_t *dstp1_orig = vsapi->getWritePtr(dst[0], rh->order[2]);
+    for (int n = first; n <= last; n++) {
+        if (pf_find_slot(pf, n) >= 0) {
+            continue;
+        }
+        for (int i = 0; i < pf->num_slots; i++) {
+            pf_slot_t *slot = pf->slots + i;
+            if (slot->users > 0 || slot->state == PF_LOADING) {
+                continue;
+            }
+            if (slot->state == PF_EMPTY || slot->frame < first - 1 ||
+                slot->frame > last) {
+                *frame = n;
+                return slot;
+            }
+        }
+        return NULL;
+    }
 
-    for (int y = 0; y < height; y++) {
-        struct uv_t *srcp = (struct uv_t *)(srcp_orig + y * src_stride);
-        uint32_t *dstp0 = (uint32_t *)(dstp0_orig + y * dst_stride);
-        uint32_t *dstp1 = (uint32_t *)(dstp1_orig + y * dst_stride);
-        for (int x = 0; x < row_size; x++) {
-            dstp0[x] = bitor8to32(srcp[x].c[6], srcp[x].c[4], srcp[x].c[2],
-                                  srcp[x].c[0]);
-            dstp1[x] = bitor8to32(srcp[x].c[7], srcp[x].c[5], srcp[x].c[3],
-                                  srcp[x].c[1]);
+    return NULL;
+}
+
+
+/* the offsets of a sidecar index are only trusted once they leave room for
+   a FRAME line after the previous frame, and for their own frame before the
+   next one and the end of the file. this is checked whenever a frame is
+   read, which costs nothing next to the read itself, instead of walking
+   the whole index when the source is opened. returns -1 on a mismatch. */
+static int64_t index_pos(const rs_hnd_t *rh, int n)
+{
+    const int64_t *index = rh->index;
+    int64_t pos = index[n];
+    if (!rh->index_map) {
+        return pos;
+    }
+    if (pos < rh->off_header + 6 || pos > rh->file_size - rh->frame_size) {
+        return -1;
+    }
+    if (n > 0 && index[n - 1] > pos - rh->frame_size - 6) {
+        return -1;
+    }
+    if (n + 1 < rh->vi[0].numFrames && index[n + 1] < pos + rh->frame_size + 6) {
+        return -1;
+    }
+    return pos;
+}
+
+
+/* queues the reads of one frame into the ring: one per plane of the source
+   layout, and plane ranges larger than URING_CHUNK_SIZE are split further so
+   a huge frame keeps several requests in flight on the device. */
+static void pf_queue_frame(const rs_hnd_t *rh, pf_slot_t *slot)
+{
+    prefetcher_t *pf = rh->pf;
+    int64_t pos = index_pos(rh, slot->frame);
+    int64_t need = pos + rh->frame_size;
+    int64_t start = pos;
+    int64_t end = need;
+    int64_t mask = 0;
+    if (rh->direct_io) {
+        mask = DIRECT_IO_ALIGNMENT - 1;
+        start &= ~mask;
+        end = (end + mask) & ~mask;
+    }
+    slot->srcp = slot->buff + (pos - start);
+    slot->pending = 0;
+    slot->failed = 0;
+
+    uint64_t id = (uint64_t)(slot - pf->slots) << 32;
+    int64_t cur = start;
+    for (int p = 1; p <= rh->num_src_planes; p++) {
+        int64_t next = p < rh->num_src_planes ?
+                       (pos + rh->plane_offset[p]) & ~mask : end;
+        while (cur < next) {
+            int64_t size = next - cur;
+            if (size > URING_CHUNK_SIZE) {
+                size = URING_CHUNK_SIZE;
+            }
+            int64_t expect = (cur + size < need ? cur + size : need) - cur;
+            if (expect < 0) {
+                expect = 0;
+            }
+            rs_uring_queue_read(pf->ring, rh->fd, slot->buff + (cur - start),
+                                (uint32_t)size, cur, id | (uint64_t)expect);
+            slot->pending++;
+            cur += size;
         }
     }
 }
 
 
-static void VS_CC
-write_px1x_frame(rs_hnd_t *rh, VSFrameRef **dst, const VSAPI *vsapi,
-                 VSCore *core)
+/* io_uring variant of the prefetch loop: every frame of the window which can
+   be started is queued and submitted in one batch, and slots are completed
+   as their reads come back. */
+static void prefetch_uring(rs_hnd_t *rh)
 {
-    struct uv16_t {
-        uint16_t c[2];
-    };
+    prefetcher_t *pf = rh->pf;
+    unsigned in_flight = 0;
+
+    rs_mutex_lock(&pf->mutex);
+    while (pf->running || in_flight > 0) {
+        unsigned queued = 0;
+        int frame;
+        pf_slot_t *slot;
+        while (pf->running &&
+               in_flight + queued + pf->max_chunks <= URING_MAX_ENTRIES &&
+               rs_uring_space(pf->ring) >= pf->max_chunks &&
+               (slot = pf_next_job(pf, rh->vi[0].numFrames, &frame))) {
+            slot->frame = frame;
+            if (index_pos(rh, frame) < 0) {
+                slot->state = PF_FAILED;
+                rs_cond_broadcast(&pf->cond);
+                continue;
+            }
+            slot->state = PF_LOADING;
+            pf_queue_frame(rh, slot);
+            queued += slot->pending;
+        }
+        if (queued == 0 && in_flight == 0) {
+            if (pf->running) {
+                rs_cond_wait(&pf->cond, &pf->mutex);
+            }
+            continue;
+        }
+        in_flight += queued;
+        rs_mutex_unlock(&pf->mutex);
+
+        /* EAGAIN and EBUSY are transient (the ring is busy with completions),
+           the entries stay published and are passed again next time. */
+        int ret = rs_uring_submit(pf->ring, 1);
+        int err = errno;
+
+        rs_mutex_lock(&pf->mutex);
+        if (ret < 0 && err != EAGAIN && err != EBUSY) {
+            /* the ring is unusable: whatever is still loading fails, so its
+               waiters read the frame themselves, and the caller carries on
+               with plain reads. */
+            for (int i = 0; i < pf->num_slots; i++) {
+                if (pf->slots[i].state == PF_LOADING) {
+                    pf->slots[i].state = PF_FAILED;
+                }
+            }
+            rs_cond_broadcast(&pf->cond);
+            rs_uring_destroy(pf->ring);
+            pf->ring = NULL;
+            break;
+        }
+        uint64_t id;
+        int res;
+        while (rs_uring_reap(pf->ring, &id, &res)) {
+            slot = pf->slots + (id >> 32);
+            if (res < (int64_t)(uint32_t)id) {
+                slot->failed = 1;
+            }
+            in_flight--;
+            if (--slot->pending == 0) {
+                slot->state = slot->failed ? PF_FAILED : PF_READY;
+                rs_cond_broadcast(&pf->cond);
+            }
+        }
+    }
+    rs_mutex_unlock(&pf->mutex);
+}
+
 
-    uint8_t *srcp_orig = rh->frame_buff;
+static RS_THREAD_FUNC prefetch_thread(void *arg)
+{
+    rs_hnd_t *rh = (rs_hnd_t *)arg;
+    prefetcher_t *pf = rh->pf;
 
-    int row_size = vsapi->getFrameWidth(dst[0], 0) << 1;
-    row_size = (row_size + rh->row_adjust) & (~rh->row_adjust);
-    int height = vsapi->getFrameHeight(dst[0], 0);
-    rs_bit_blt(srcp_orig, row_size, height, dst[0], 0, vsapi);
+    /* returns on shutdown, or when the ring failed and the pread loop takes
+       over. */
+    if (pf->ring) {
+        prefetch_uring(rh);
+    }
 
-    srcp_orig += row_size * height;
-    int src_stride = row_size;
-    row_size = vsapi->getFrameWidth(dst[0], 1);
-    height = vsapi->getFrameHeight(dst[0], 1);
-    int dst_stride = vsapi->getStride(dst[0], 1) >> 1;
-    uint16_t *dstp0 = (uint16_t *)vsapi->getWritePtr(dst[0], rh->order[1]);
-    uint16_t *dstp1 = (uint16_t *)vsapi->getWritePtr(dst[0], rh->order[2]);
+    rs_mutex_lock(&pf->mutex);
+    while (pf->running) {
+        int frame;
+        pf_slot_t *slot = pf_next_job(pf, rh->vi[0].numFrames, &frame);
+        if (!slot) {
+            rs_cond_wait(&pf->cond, &pf->mutex);
+            continue;
+        }
+        slot->frame = frame;
+        slot->state = PF_LOADING;
+        rs_mutex_unlock(&pf->mutex);
 
-    for (int y = 0; y < height; y++) {
-        struct uv16_t *srcp_uv = (struct uv16_t *)(srcp_orig + y *src_stride);
-        for (int x = 0; x < row_size; x++) {
-            dstp0[x] = srcp_uv[x].c[0];
-            dstp1[x] = srcp_uv[x].c[1];
+        int64_t pos = index_pos(rh, frame);
+        const uint8_t *srcp = pos < 0 ? NULL : read_frame(rh, pos, slot->buff);
+
+        rs_mutex_lock(&pf->mutex);
+        slot->srcp = srcp;
+        slot->state = srcp ? PF_READY : PF_FAILED;
+        rs_cond_broadcast(&pf->cond);
+    }
+    rs_mutex_unlock(&pf->mutex);
+
+    return 0;
+}
+
+
+/* returns the slot holding frame n if it has been read ahead (waiting for an
+   in-flight read of it), or NULL on a miss. requests close to the previous
+   ones keep the read-ahead going, anything else stops it until the access
+   pattern turns sequential again. */
+static pf_slot_t *prefetch_get(prefetcher_t *pf, int n, int64_t *hits,
+                               int64_t *misses)
+{
+    rs_mutex_lock(&pf->mutex);
+
+    if (n > pf->last_frame - pf->window && n <= pf->last_frame + pf->window) {
+        pf->active = 1;
+        if (n > pf->last_frame) {
+            pf->last_frame = n;
+        }
+    } else {
+        pf->active = 0;
+        pf->last_frame = n;
+    }
+
+    pf_slot_t *slot = NULL;
+    int i;
+    while ((i = pf_find_slot(pf, n)) >= 0 && pf->slots[i].state == PF_LOADING) {
+        rs_cond_wait(&pf->cond, &pf->mutex);
+    }
+    if (i >= 0 && pf->slots[i].state == PF_READY) {
+        slot = pf->slots + i;
+        slot->users++;
+        pf->hits++;
+    } else {
+        pf->misses++;
+    }
+    *hits = pf->hits;
+    *misses = pf->misses;
+
+    rs_cond_broadcast(&pf->cond);
+    rs_mutex_unlock(&pf->mutex);
+    return slot;
+}
+
+
+static void prefetch_release(prefetcher_t *pf, pf_slot_t *slot)
+{
+    rs_mutex_lock(&pf->mutex);
+    if (--slot->users == 0) {
+        rs_cond_broadcast(&pf->cond);
+    }
+    rs_mutex_unlock(&pf->mutex);
+}
+
+
+static void stop_prefetcher(rs_hnd_t *rh)
+{
+    prefetcher_t *pf = rh->pf;
+    if (!pf) {
+        return;
+    }
+
+    if (pf->running) {
+        rs_mutex_lock(&pf->mutex);
+        pf->running = 0;
+        rs_cond_broadcast(&pf->cond);
+        rs_mutex_unlock(&pf->mutex);
+        rs_thread_join(pf->thread);
+    }
+    for (int i = 0; i < pf->num_slots; i++) {
+        pool_release(&rh->pool, pf->slots[i].buff);
+    }
+    rs_uring_destroy(pf->ring);
+    rs_cond_destroy(&pf->cond);
+    rs_mutex_destroy(&pf->mutex);
+    free(pf->slots);
+    free(pf);
+    rh->pf = NULL;
+}
+
+
+static const char *start_prefetcher(rs_hnd_t *rh, int window, int use_uring)
+{
+    prefetcher_t *pf = (prefetcher_t *)calloc(1, sizeof(prefetcher_t));
+    if (!pf) {
+        return "failed to allocate prefetcher";
+    }
+    rs_mutex_init(&pf->mutex);
+    rs_cond_init(&pf->cond);
+    pf->window = window;
+    pf->last_frame = -1;
+    rh->pf = pf;
+
+    pf->slots = (pf_slot_t *)calloc(window + 1, sizeof(pf_slot_t));
+    if (!pf->slots) {
+        return "failed to allocate prefetcher";
+    }
+    pf->num_slots = window + 1;
+    for (int i = 0; i < pf->num_slots; i++) {
+        pf->slots[i].frame = -1;
+        pf->slots[i].buff = pool_get(&rh->pool);
+        if (!pf->slots[i].buff) {
+            return "failed to allocate prefetch buffers";
+        }
+    }
+
+    /* falls back to the pread loop if io_uring is not available. */
+    if (use_uring) {
+        pf->max_chunks = rh->frame_size / URING_CHUNK_SIZE + rh->num_src_planes + 1;
+        unsigned entries = pf->max_chunks * pf->num_slots;
+        pf->ring = rs_uring_create(entries < URING_MAX_ENTRIES ?
+                                   entries : URING_MAX_ENTRIES);
+    }
+
+    pf->running = 1;
+    if (rs_thread_create(&pf->thread, prefetch_thread, rh) != 0) {
+        pf->running = 0;
+        return "failed to create prefetch thread";
+    }
+
+    return NULL;
+}
+
+
+/* decoded frames are kept in an lru list threaded through the entries
+   array. head is the most recently used entry, lookup maps a frame number
+   to its entry or -1. */
+static void cache_unlink(frame_cache_t *c, int e)
+{
+    cache_entry_t *entry = &c->entries[e];
+    if (entry->prev >= 0) {
+        c->entries[entry->prev].next = entry->next;
+    } else {
+        c->head = entry->next;
+    }
+    if (entry->next >= 0) {
+        c->entries[entry->next].prev = entry->prev;
+    } else {
+        c->tail = entry->prev;
+    }
+}
+
+
+static void cache_push_front(frame_cache_t *c, int e)
+{
+    c->entries[e].prev = -1;
+    c->entries[e].next = c->head;
+    if (c->head >= 0) {
+        c->entries[c->head].prev = e;
+    } else {
+        c->tail = e;
+    }
+    c->head = e;
+}
+
+
+/* returns a new reference to output out of frame n, or NULL on a miss. */
+static const VSFrameRef *cache_get(frame_cache_t *c, int n, int out)
+{
+    const VSFrameRef *ret = NULL;
+
+    rs_mutex_lock(&c->mutex);
+    int e = c->lookup[n];
+    if (e >= 0) {
+        if (e != c->head) {
+            cache_unlink(c, e);
+            cache_push_front(c, e);
+        }
+        ret = c->vsapi->cloneFrameRef(c->entries[e].frames[out]);
+    }
+    rs_mutex_unlock(&c->mutex);
+
+    return ret;
+}
+
+
+/* stores references to all outputs of frame n, evicting the least
+   recently used frame when the budget is used up. */
+static void cache_put(frame_cache_t *c, int n, VSFrameRef **dst)
+{
+    rs_mutex_lock(&c->mutex);
+    if (c->lookup[n] < 0) {
+        int e;
+        if (c->count < c->capacity) {
+            e = c->count++;
+        } else {
+            e = c->tail;
+            cache_unlink(c, e);
+            c->lookup[c->entries[e].frame] = -1;
+            for (int i = 0; i < c->num_outputs; i++) {
+                c->vsapi->freeFrame(c->entries[e].frames[i]);
+            }
+        }
+        c->entries[e].frame = n;
+        for (int i = 0; i < c->num_outputs; i++) {
+            c->entries[e].frames[i] = c->vsapi->cloneFrameRef(dst[i]);
+        }
+        c->lookup[n] = e;
+        cache_push_front(c, e);
+    }
+    rs_mutex_unlock(&c->mutex);
+}
+
+
+static void stop_cache(rs_hnd_t *rh)
+{
+    frame_cache_t *c = rh->cache;
+    if (!c) {
+        return;
+    }
+
+    for (int e = 0; e < c->count; e++) {
+        for (int i = 0; i < c->num_outputs; i++) {
+            c->vsapi->freeFrame(c->entries[e].frames[i]);
+        }
+    }
+    rs_mutex_destroy(&c->mutex);
+    free(c->entries);
+    free(c->lookup);
+    free(c);
+    rh->cache = NULL;
+}
+
+
+/* bytes held by one frame of vi, with rows padded the way the core
+   allocates them. */
+static size_t frame_bytes(const VSVideoInfo *vi)
+{
+    const VSFormat *f = vi->format;
+    size_t size = 0;
+
+    for (int p = 0; p < f->numPlanes; p++) {
+        int width = vi->width >> (p ? f->subSamplingW : 0);
+        int height = vi->height >> (p ? f->subSamplingH : 0);
+        size += (size_t)((width * f->bytesPerSample + 31) & ~31) * height;
+    }
+    return size;
+}
+
+
+static const char *start_cache(rs_hnd_t *rh, int budget_mb, const VSAPI *vsapi)
+{
+    int num_outputs = rh->has_alpha + 1;
+    size_t entry_size = 0;
+    for (int i = 0; i < num_outputs; i++) {
+        entry_size += frame_bytes(&rh->vi[i]);
+    }
+
+    int64_t capacity = ((int64_t)budget_mb << 20) / (int64_t)entry_size;
+    if (capacity > rh->vi[0].numFrames) {
+        capacity = rh->vi[0].numFrames;
+    }
+    if (capacity < 1) {
+        return NULL;
+    }
+
+    frame_cache_t *c = (frame_cache_t *)calloc(1, sizeof(frame_cache_t));
+    if (!c) {
+        return "failed to allocate frame cache";
+    }
+    rs_mutex_init(&c->mutex);
+    c->vsapi = vsapi;
+    c->num_outputs = num_outputs;
+    c->capacity = (int)capacity;
+    c->head = c->tail = -1;
+    rh->cache = c;
+
+    c->entries = (cache_entry_t *)calloc(c->capacity, sizeof(cache_entry_t));
+    c->lookup = (int *)malloc(sizeof(int) * rh->vi[0].numFrames);
+    if (!c->entries || !c->lookup) {
+        return "failed to allocate frame cache";
+    }
+    for (int i = 0; i < rh->vi[0].numFrames; i++) {
+        c->lookup[i] = -1;
+    }
+
+    return NULL;
+}
+
+
+/* alpha formats decode both outputs at once. the output which was not
+   asked for is parked here until its own request comes in, and a request
+   for a frame still being decoded waits for that decode instead of
+   starting another one.
+   returns the entry the caller has to decode into, or -1. in the latter
+   case *ret holds the shared frame, or NULL if the caller should decode
+   without sharing (same output asked twice, or every entry busy). */
+static int sibling_claim(sibling_set_t *s, int n, int out, const VSFrameRef **ret)
+{
+    *ret = NULL;
+
+    rs_mutex_lock(&s->mutex);
+    for (;;) {
+        sibling_t *found = NULL;
+        for (int i = 0; i < s->num_entries; i++) {
+            if (s->entries[i].frame == n) {
+                found = &s->entries[i];
+                break;
+            }
+        }
+        if (!found) {
+            break;
+        }
+        if (found->decoding) {
+            rs_cond_wait(&s->cond, &s->mutex);
+            continue;
+        }
+        if (found->pending & (1 << out)) {
+            *ret = found->frames[out];
+            found->frames[out] = NULL;
+            found->pending &= ~(1 << out);
+            if (found->pending == 0) {
+                found->frame = -1;
+            }
+        }
+        rs_mutex_unlock(&s->mutex);
+        return -1;
+    }
+
+    /* takes a free entry, or else drops the oldest parked frame. */
+    int e = -1;
+    for (int i = 0; i < s->num_entries; i++) {
+        sibling_t *entry = &s->entries[i];
+        if (entry->frame < 0) {
+            e = i;
+            break;
+        }
+        if (!entry->decoding && (e < 0 || entry->seq < s->entries[e].seq)) {
+            e = i;
+        }
+    }
+    if (e >= 0) {
+        sibling_t *entry = &s->entries[e];
+        for (int i = 0; i < 2; i++) {
+            s->vsapi->freeFrame(entry->frames[i]);
+            entry->frames[i] = NULL;
+        }
+        entry->frame = n;
+        entry->decoding = 1;
+        entry->pending = 0;
+        entry->seq = s->seq++;
+    }
+    rs_mutex_unlock(&s->mutex);
+
+    return e;
+}
+
+
+/* parks every output but out, taking over the caller's references. */
+static void sibling_publish(sibling_set_t *s, int e, VSFrameRef **dst, int out)
+{
+    rs_mutex_lock(&s->mutex);
+    sibling_t *entry = &s->entries[e];
+    for (int i = 0; i < 2; i++) {
+        if (i != out) {
+            entry->frames[i] = dst[i];
+            entry->pending |= 1 << i;
+        }
+    }
+    entry->decoding = 0;
+    rs_cond_broadcast(&s->cond);
+    rs_mutex_unlock(&s->mutex);
+}
+
+
+static void sibling_abort(sibling_set_t *s, int e)
+{
+    rs_mutex_lock(&s->mutex);
+    s->entries[e].frame = -1;
+    s->entries[e].decoding = 0;
+    rs_cond_broadcast(&s->cond);
+    rs_mutex_unlock(&s->mutex);
+}
+
+
+static void stop_siblings(rs_hnd_t *rh)
+{
+    sibling_set_t *s = rh->siblings;
+    if (!s) {
+        return;
+    }
+
+    if (s->entries) {
+        for (int e = 0; e < s->num_entries; e++) {
+            for (int i = 0; i < 2; i++) {
+                s->vsapi->freeFrame(s->entries[e].frames[i]);
+            }
+        }
+    }
+    rs_cond_destroy(&s->cond);
+    rs_mutex_destroy(&s->mutex);
+    free(s->entries);
+    free(s);
+    rh->siblings = NULL;
+}
+
+
+static const char *start_siblings(rs_hnd_t *rh, int num_entries, const VSAPI *vsapi)
+{
+    sibling_set_t *s = (sibling_set_t *)calloc(1, sizeof(sibling_set_t));
+    if (!s) {
+        return "failed to allocate sibling frames";
+    }
+    rs_mutex_init(&s->mutex);
+    rs_cond_init(&s->cond);
+    s->vsapi = vsapi;
+    rh->siblings = s;
+
+    s->entries = (sibling_t *)calloc(num_entries, sizeof(sibling_t));
+    if (!s->entries) {
+        return "failed to allocate sibling frames";
+    }
+    s->num_entries = num_entries;
+    for (int i = 0; i < num_entries; i++) {
+        s->entries[i].frame = -1;
+    }
+
+    return NULL;
+}
+
+
+typedef struct {
+    const region_t *regions;
+    int num_regions;
+    const uint8_t *srcp;
+    rs_fd_t fd;
+    int64_t pos;
+    buff_pool_t *chunks;
+    buff_pool_t *scratch;
+    int band_rows[MAX_REGIONS];
+    int first_band[MAX_REGIONS + 1];
+} band_job_t;
+
+
+/* rows long enough to be worth it bypass the cache when stream_copy is
+   given, as nothing reads the frame back before it is handed out. */
+static void
+rs_bit_blt(const uint8_t *srcp, int src_stride, int row_size, int height,
+           uint8_t *dstp, int dst_stride, func_stream_copy stream_copy)
+{
+    if (stream_copy && row_size >= STREAM_MIN_ROW) {
+        stream_copy(srcp, src_stride, dstp, dst_stride, row_size, height);
+        return;
+    }
+
+    if (row_size == src_stride && row_size == dst_stride) {
+        memcpy(dstp, srcp, (size_t)row_size * height);
+        return;
+    }
+
+    for (int i = 0; i < height; i++) {
+        memcpy(dstp, srcp, row_size);
+        dstp += dst_stride;
+        srcp += src_stride;
+    }
+}
+
+
+/* srcp points at row y of the region, whose rows are src_stride apart
+   there. scratch holds one decimated row for the kernel, followed by the
+   rows it unpacks when they are converted, tmp_stride apart. */
+static void
+run_rows(const region_t *r, const uint8_t *srcp, int src_stride, int y,
+         int rows, uint8_t *scratch)
+{
+    if (!r->unpack && !r->convert) {
+        uint8_t *dstp = r->dstp[0] + (size_t)y * r->dst_stride[0];
+        if (!r->decimate) {
+            rs_bit_blt(srcp, src_stride, r->width, rows, dstp,
+                       r->dst_stride[0], r->stream_copy);
+            return;
+        }
+        for (int i = 0; i < rows; i++) {
+            r->decimate(srcp, dstp, r->num_units, r->factor);
+            srcp += src_stride;
+            dstp += r->dst_stride[0];
+        }
+        return;
+    }
+
+    uint8_t *dstp[4];
+    uint8_t *tmp[4];
+    for (int i = 0; i < r->num_dst; i++) {
+        dstp[i] = r->dstp[i] + (size_t)y * r->dst_stride[i];
+        tmp[i] = r->convert ? scratch + (size_t)(i + 1) * r->tmp_stride : dstp[i];
+    }
+    for (int i = 0; i < rows; i++) {
+        const uint8_t *row = srcp;
+        if (r->decimate) {
+            r->decimate(srcp, scratch, r->num_units, r->factor);
+            row = scratch;
+        }
+        if (!r->convert) {
+            r->unpack(row, dstp, r->width);
+        } else {
+            if (r->unpack) {
+                r->unpack(row, tmp, r->width);
+            }
+            for (int j = 0; j < r->num_dst; j++) {
+                r->convert(r->unpack ? tmp[j] : row, dstp[j], r->conv_width[j],
+                           r->cv + j);
+            }
+        }
+        srcp += src_stride;
+        for (int j = 0; j < r->num_dst; j++) {
+            dstp[j] += r->dst_stride[j];
+        }
+    }
+}
+
+
+/* rows further apart than SPARSE_MIN_GAP, as a proxy leaves them, are
+   read one by one, so that the pages between them are never touched.
+   returns the stride of the rows in buff or -1. */
+static int
+read_band_rows(rs_fd_t fd, int64_t offset, const region_t *r, int rows,
+               uint8_t *buff)
+{
+    if (r->src_stride - r->row_size < SPARSE_MIN_GAP) {
+        size_t size = (size_t)(rows - 1) * r->src_stride + r->row_size;
+        return rs_pread(fd, buff, size, offset) == (int64_t)size ? r->src_stride : -1;
+    }
+    for (int i = 0; i < rows; i++) {
+        if (rs_pread(fd, buff + (size_t)i * r->row_size, r->row_size,
+                     offset + (int64_t)i * r->src_stride) != r->row_size) {
+            return -1;
+        }
+    }
+    return r->row_size;
+}
+
+
+/* the kernel needs a scratch row for rows which are decimated before they
+   are unpacked or converted, and converted rows are unpacked into the
+   scratch rows after it. */
+static int uses_scratch(const region_t *r)
+{
+    return r->unpack ? r->decimate || r->convert : r->decimate && r->convert;
+}
+
+
+/* without srcp the rows of the band are read from the file into a chunk
+   small enough to stay in cache until they are unpacked, or straight into
+   the frame when they are only copied. */
+static int run_band(void *ctx, int band)
+{
+    const band_job_t *job = (const band_job_t *)ctx;
+    int i = 0;
+    while (band >= job->first_band[i + 1]) {
+        i++;
+    }
+    const region_t *r = job->regions + i;
+    int y = (band - job->first_band[i]) * job->band_rows[i];
+    int rows = r->height - y < job->band_rows[i] ? r->height - y : job->band_rows[i];
+    size_t offset = r->offset + (size_t)y * r->src_stride;
+
+    uint8_t *scratch = NULL;
+    if (uses_scratch(r)) {
+        scratch = pool_get(job->scratch);
+        if (!scratch) {
+            return -1;
+        }
+    }
+
+    if (job->srcp) {
+        run_rows(r, job->srcp + offset, r->src_stride, y, rows, scratch);
+        pool_release(job->scratch, scratch);
+        return 0;
+    }
+
+    int direct = !r->unpack && !r->decimate && !r->convert &&
+                 r->row_size <= r->dst_stride[0];
+    uint8_t *chunk = NULL;
+    if (!direct || r->row_size < r->src_stride) {
+        chunk = pool_get(job->chunks);
+        if (!chunk) {
+            pool_release(job->scratch, scratch);
+            return -1;
+        }
+    }
+
+    int ret = -1;
+    if (direct) {
+        ret = rs_pread_rows(job->fd, job->pos + offset, r->src_stride,
+                            r->row_size, rows,
+                            r->dstp[0] + (size_t)y * r->dst_stride[0],
+                            r->dst_stride[0], chunk);
+    } else {
+        int stride = read_band_rows(job->fd, job->pos + offset, r, rows, chunk);
+        if (stride > 0) {
+            run_rows(r, chunk, stride, y, rows, scratch);
+            ret = 0;
+        }
+    }
+    pool_release(job->chunks, chunk);
+    pool_release(job->scratch, scratch);
+    return ret;
+}
+
+
+/* the regions are cut into bands of about BAND_SIZE source bytes. the
+   worker threads share them out when there are any, otherwise a frame in
+   memory is run in one go and a frame in the file band by band. returns
+   -1 when the frame could not be read. */
+static int
+run_regions(const rs_hnd_t *rh, const uint8_t *srcp, int64_t pos,
+            const region_t *regions, int num_regions)
+{
+    band_job_t job = { regions, num_regions, srcp, rh->fd, pos,
+                       (buff_pool_t *)&rh->chunks,
+                       (buff_pool_t *)&rh->scratch };
+    for (int i = 0; i < num_regions; i++) {
+        const region_t *r = regions + i;
+        int rows = BAND_SIZE / (r->src_stride > 0 ? r->src_stride : 1);
+        job.band_rows[i] = rows > 0 ? rows : 1;
+        job.first_band[i + 1] = job.first_band[i]
+            + (r->height + job.band_rows[i] - 1) / job.band_rows[i];
+    }
+    int num_bands = job.first_band[num_regions];
+
+    if (rh->workers && num_bands > 1) {
+        return rs_workers_run(rh->workers, run_band, &job, num_bands);
+    }
+
+    if (srcp) {
+        uint8_t *scratch = NULL;
+        if (rh->scratch.size > 0) {
+            scratch = pool_get(job.scratch);
+            if (!scratch) {
+                return -1;
+            }
+        }
+        for (int i = 0; i < num_regions; i++) {
+            run_rows(regions + i, srcp + regions[i].offset,
+                     regions[i].src_stride, 0, regions[i].height, scratch);
+        }
+        pool_release(job.scratch, scratch);
+        return 0;
+    }
+    for (int i = 0; i < num_bands; i++) {
+        if (run_band(&job, i) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/* byte offset of the first sample the crop keeps in a source plane, for
+   samples of bytes_per_pixel bytes subsampled by ssw and ssh. */
+static size_t
+crop_offset(const rs_hnd_t *rh, int src_stride, int bytes_per_pixel, int ssw,
+            int ssh)
+{
+    return (size_t)(rh->crop_top >> ssh) * src_stride +
+           (size_t)(rh->crop_left >> ssw) * bytes_per_pixel;
+}
+
+
+/* a proxy takes every proxy-th row and column, so the rows of the source
+   are that many times as far apart and as long as the output ones. */
+static void
+set_decimation(const rs_hnd_t *rh, region_t *r, func_decimate_row decimate,
+               int unit)
+{
+    if (rh->proxy > 1) {
+        r->num_units = r->row_size / unit;
+        r->src_stride *= rh->proxy;
+        r->row_size *= rh->proxy;
+        r->decimate = decimate;
+        r->factor = rh->proxy;
+    }
+}
+
+
+/* points output k of r at a plane of frame. converted yuv chroma is
+   centred on zero when it is float. */
+static void
+set_output(const rs_hnd_t *rh, region_t *r, int k, VSFrameRef *frame,
+           int plane, const VSAPI *vsapi)
+{
+    r->dstp[k] = vsapi->getWritePtr(frame, plane);
+    r->dst_stride[k] = vsapi->getStride(frame, plane);
+    r->conv_width[k] = vsapi->getFrameWidth(frame, plane);
+    r->cv[k] = rh->convert;
+    if (rh->src_fi->colorFamily == cmYUV && plane > 0) {
+        r->cv[k].bias = rh->chroma_bias;
+    }
+}
+
+
+/* big-endian planes are byte-swapped on their way instead of copied.
+   row_size counts the source bytes of a destination row. */
+static void
+set_copy_region(const rs_hnd_t *rh, region_t *r, size_t offset, int src_stride,
+                int row_size, int height, VSFrameRef *dst, int plane,
+                const VSAPI *vsapi)
+{
+    int bps = rh->src_fi->bytesPerSample;
+    memset(r, 0, sizeof(region_t));
+    r->offset = offset;
+    r->stream_copy = rh->stream_copy;
+    r->src_stride = src_stride;
+    r->row_size = row_size;
+    r->width = row_size;
+    r->height = height;
+    if (rh->swap_row) {
+        r->unpack = rh->swap_row;
+        r->width = row_size / bps;
+    }
+    set_decimation(rh, r, rh->copy_decimate, bps);
+    r->convert = rh->convert_row;
+    r->tmp_stride = rh->tmp_stride;
+    r->num_dst = 1;
+    set_output(rh, r, 0, dst, plane, vsapi);
+}
+
+
+static void
+set_unpack_region(const rs_hnd_t *rh, region_t *r, size_t offset,
+                  int src_stride, int bytes_per_pixel, int width, int height)
+{
+    memset(r, 0, sizeof(region_t));
+    r->offset = offset;
+    r->src_stride = src_stride;
+    r->row_size = width * bytes_per_pixel;
+    r->width = width;
+    r->height = height;
+    r->unpack = rh->unpack_row;
+    set_decimation(rh, r, rh->unpack_decimate, rh->unpack_unit);
+    r->convert = rh->convert_row;
+    r->tmp_stride = rh->tmp_stride;
+}
+
+
+/* the planes which planes= leaves out are black, or neutral grey for the
+   chroma planes of yuv formats. */
+static void
+blank_plane(const rs_hnd_t *rh, VSFrameRef *frame, int plane,
+            const VSAPI *vsapi)
+{
+    const VSFormat *fi = rh->vi[0].format;
+    int value = fi->colorFamily == cmYUV && plane > 0 &&
+                fi->sampleType == stInteger ? 1 << (fi->bitsPerSample - 1) : 0;
+    int width = vsapi->getFrameWidth(frame, plane);
+    int height = vsapi->getFrameHeight(frame, plane);
+    int stride = vsapi->getStride(frame, plane);
+    uint8_t *dstp = vsapi->getWritePtr(frame, plane);
+
+    for (int y = 0; y < height; y++) {
+        if (fi->bytesPerSample == 2) {
+            uint16_t *p = (uint16_t *)dstp;
+            for (int x = 0; x < width; x++) {
+                p[x] = (uint16_t)value;
+            }
+        } else {
+            memset(dstp, value, (size_t)width * fi->bytesPerSample);
+        }
+        dstp += stride;
+    }
+}
+
+
+static int VS_CC
+layout_planar_frame(const rs_hnd_t *rh, VSFrameRef **dst, region_t *regions,
+                    const VSAPI *vsapi, VSCore *core)
+{
+    const VSFormat *fi = rh->src_fi;
+    int bps = fi->bytesPerSample;
+    size_t offset = 0;
+    int num = fi->numPlanes;
+    int n = 0;
+
+    if (rh->has_alpha) {
+        dst[1] = vsapi->newVideoFrame(rh->vi[1].format, rh->vi[1].width,
+                                      rh->vi[1].height, NULL, core);
+    }
+
+    for (int i = 0; i < num + rh->has_alpha; i++) {
+        int ssw = i && i < num ? fi->subSamplingW : 0;
+        int ssh = i && i < num ? fi->subSamplingH : 0;
+        int src_stride = ((rh->src_width >> ssw) * bps + rh->row_adjust) & (~rh->row_adjust);
+        size_t plane_offset = offset;
+        offset += (size_t)src_stride * (rh->src_height >> ssh);
+        VSFrameRef *frame = i < num ? dst[0] : dst[1];
+        int plane = i < num ? rh->order[i] : 0;
+        if (i < num && !(rh->plane_mask & (1 << plane))) {
+            if (plane < rh->vi[0].format->numPlanes) {
+                blank_plane(rh, frame, plane, vsapi);
+            }
+            continue;
+        }
+        int height = vsapi->getFrameHeight(frame, plane);
+        set_copy_region(rh, regions + n++,
+                        plane_offset + crop_offset(rh, src_stride, bps, ssw, ssh),
+                        src_stride, vsapi->getFrameWidth(frame, plane) * bps,
+                        height, frame, plane, vsapi);
+    }
+
+    return n;
+}
+
+
+/* the chroma rows of nv12 and p010 interleave u and v at the stride of the
+   luma rows, so a pair of samples is 2 * bps bytes. planes= takes or
+   leaves out both chroma planes together. */
+static int
+layout_biplanar(const rs_hnd_t *rh, VSFrameRef **dst, region_t *regions,
+                int bps, const VSAPI *vsapi)
+{
+    const VSFormat *fi = rh->src_fi;
+    int src_stride = (rh->src_width * bps + rh->row_adjust) & (~rh->row_adjust);
+    int n = 0;
+    if (rh->plane_mask & 1) {
+        set_copy_region(rh, regions + n++, crop_offset(rh, src_stride, bps, 0, 0),
+                        src_stride, rh->vi[0].width * bps, rh->vi[0].height,
+                        dst[0], 0, vsapi);
+    } else {
+        blank_plane(rh, dst[0], 0, vsapi);
+    }
+
+    if (!(rh->plane_mask & 6)) {
+        return n;
+    }
+    region_t *r = regions + n++;
+    size_t offset = (size_t)src_stride * rh->src_height +
+                    crop_offset(rh, src_stride, bps * 2, fi->subSamplingW,
+                                fi->subSamplingH);
+    set_unpack_region(rh, r, offset, src_stride, bps * 2,
+                      vsapi->getFrameWidth(dst[0], 1),
+                      vsapi->getFrameHeight(dst[0], 1));
+    r->num_dst = 2;
+    for (int i = 0; i < 2; i++) {
+        set_output(rh, r, i, dst[0], rh->order[i + 1], vsapi);
+    }
+
+    return n;
+}
+
+
+static int VS_CC
+layout_nvxx_frame(const rs_hnd_t *rh, VSFrameRef **dst, region_t *regions,
+                  const VSAPI *vsapi, VSCore *core)
+{
+    return layout_biplanar(rh, dst, regions, 1, vsapi);
+}
+
+
+static int VS_CC
+layout_px1x_frame(const rs_hnd_t *rh, VSFrameRef **dst, region_t *regions,
+                  const VSAPI *vsapi, VSCore *core)
+{
+    return layout_biplanar(rh, dst, regions, 2, vsapi);
+}
+
+
+static int VS_CC
+layout_packed_rgb(const rs_hnd_t *rh, VSFrameRef **dst, region_t *regions,
+                  const VSAPI *vsapi, VSCore *core)
+{
+    int bytes_per_pixel = rh->src_fi->bytesPerSample * (3 + rh->has_alpha);
+    int src_stride = (rh->src_width * bytes_per_pixel + rh->row_adjust) & (~rh->row_adjust);
+
+    if (rh->has_alpha) {
+        dst[1] = vsapi->newVideoFrame(rh->vi[1].format, rh->vi[1].width,
+                                      rh->vi[1].height, NULL, core);
+    }
+
+    region_t *r = regions;
+    set_unpack_region(rh, r, crop_offset(rh, src_stride, bytes_per_pixel, 0, 0),
+                      src_stride, bytes_per_pixel, rh->vi[0].width,
+                      rh->vi[0].height);
+    r->num_dst = 3 + rh->has_alpha;
+    for (int i = 0; i < r->num_dst; i++) {
+        int plane = rh->order[i];
+        if (plane < 3) {
+            set_output(rh, r, i, dst[0], plane, vsapi);
+        } else {
+            set_output(rh, r, i, dst[1], 0, vsapi);
+        }
+    }
+
+    return 1;
+}
+
+
+static int VS_CC
+layout_packed_yuv422(const rs_hnd_t *rh, VSFrameRef **dst, region_t *regions,
+                     const VSAPI *vsapi, VSCore *core)
+{
+    int src_stride = ((rh->src_width << 1) + rh->row_adjust) & (~rh->row_adjust);
+
+    region_t *r = regions;
+    set_unpack_region(rh, r, crop_offset(rh, src_stride, 2, 0, 0), src_stride,
+                      2, rh->vi[0].width, rh->vi[0].height);
+
+    /* the first chroma sample follows luma for yuyv and leads for uyvy. */
+    int c = rh->order[0] == 0 ? 1 : 0;
+    int planes[3] = { 0, rh->order[c], rh->order[c + 2] };
+    r->num_dst = 3;
+    for (int i = 0; i < 3; i++) {
+        set_output(rh, r, i, dst[0], planes[i], vsapi);
+    }
+
+    return 1;
+}
+
+
+static void set_frame_props(VSFrameRef *frame, const VSVideoInfo *vi,
+                            const rs_hnd_t *rh, const VSAPI *vsapi)
+{
+    VSMap *props = vsapi->getFramePropsRW(frame);
+    vsapi->propSetInt(props, "_DurationNum", vi->fpsDen, paReplace);
+    vsapi->propSetInt(props, "_DurationDen", vi->fpsNum, paReplace);
+    vsapi->propSetInt(props, "_SARNum", rh->sar_num, paReplace);
+    vsapi->propSetInt(props, "_SARDen", rh->sar_den, paReplace);
+}
+
+
+/* allocates dst[0] and unpacks one source frame into it, and into dst[1]
+   for the alpha formats. the frame is taken from srcp, or read from the
+   file at pos while it is unpacked when srcp is NULL. returns -1 and frees
+   the frames if that read failed. */
+static int decode_frame(const rs_hnd_t *rh, const uint8_t *srcp, int64_t pos,
+                        VSFrameRef **dst, const VSAPI *vsapi, VSCore *core)
+{
+    region_t regions[MAX_REGIONS];
+    dst[0] = vsapi->newVideoFrame(rh->vi[0].format, rh->vi[0].width,
+                                  rh->vi[0].height, NULL, core);
+    dst[1] = NULL;
+    int num = rh->layout_frame(rh, dst, regions, vsapi, core);
+    if (run_regions(rh, srcp, pos, regions, num) != 0) {
+        vsapi->freeFrame(dst[0]);
+        vsapi->freeFrame(dst[1]);
+        return -1;
+    }
+    set_frame_props(dst[0], &rh->vi[0], rh, vsapi);
+    if (rh->has_alpha) {
+        set_frame_props(dst[1], &rh->vi[1], rh, vsapi);
+    }
+    return 0;
+}
+
+
+/* returns the data of the next frame of a stream, or NULL at its end. the
+   data stays valid until the stream is read again. */
+static const uint8_t *stream_next_frame(const rs_hnd_t *rh, stream_t *st)
+{
+    if (rh->is_y4m) {
+        size_t want = 6;
+        for (;;) {
+            size_t avail = stream_fill(st, rh->fd, want);
+            const uint8_t *p = st->buff + st->pos;
+            if (avail < 6 || memcmp(p, "FRAME", 5) != 0 ||
+                (p[5] != ' ' && p[5] != '\n')) {
+                return NULL;
+            }
+            const uint8_t *eol = memchr(p + 5, '\n', avail - 5);
+            if (eol) {
+                stream_consume(st, eol - p + 1);
+                break;
+            }
+            if (avail < want || want == Y4M_MAX_FRAME_HEADER) {
+                return NULL;
+            }
+            want = avail + 64 < Y4M_MAX_FRAME_HEADER ?
+                   avail + 64 : Y4M_MAX_FRAME_HEADER;
+        }
+    } else {
+        stream_skip(st, rh->fd, rh->off_frame);
+    }
+
+    if (stream_fill(st, rh->fd, rh->frame_size) < rh->frame_size) {
+        return NULL;
+    }
+    const uint8_t *srcp = st->buff + st->pos;
+    stream_consume(st, rh->frame_size);
+    return srcp;
+}
+
+
+/* frames are decoded in stream order as the requests move forward, and the
+   last window of them is kept for requests which look back a little. */
+static const VSFrameRef *
+stream_get_frame(const rs_hnd_t *rh, int n, int out, VSCore *core,
+                 const VSAPI *vsapi, const char **err)
+{
+    stream_t *st = rh->stream;
+    const VSFrameRef *ret = NULL;
+
+    rs_mutex_lock(&st->mutex);
+    while (st->next <= n) {
+        const uint8_t *srcp = stream_next_frame(rh, st);
+        if (!srcp) {
+            *err = "raws: the stream ended before the requested frame";
+            goto unlock;
+        }
+        stream_slot_t *slot = st->slots + st->next % st->window;
+        for (int i = 0; i < 2; i++) {
+            vsapi->freeFrame(slot->frames[i]);
+        }
+        VSFrameRef *dst[2];
+        decode_frame(rh, srcp, 0, dst, vsapi, core);
+        slot->frame = st->next++;
+        slot->frames[0] = dst[0];
+        slot->frames[1] = dst[1];
+    }
+
+    const stream_slot_t *slot = st->slots + n % st->window;
+    if (slot->frame != n) {
+        *err = "raws: the requested frame has already left the stream window";
+        goto unlock;
+    }
+    ret = vsapi->cloneFrameRef(slot->frames[out]);
+
+unlock:
+    rs_mutex_unlock(&st->mutex);
+    return ret;
+}
+
+
+static void stop_stream(rs_hnd_t *rh)
+{
+    stream_t *st = rh->stream;
+    if (!st) {
+        return;
+    }
+
+    if (st->slots) {
+        for (int i = 0; i < st->window; i++) {
+            for (int j = 0; j < 2; j++) {
+                st->vsapi->freeFrame(st->slots[i].frames[j]);
+            }
+        }
+    }
+    rs_mutex_destroy(&st->mutex);
+    free(st->slots);
+    free(st->buff);
+    free(st);
+    rh->stream = NULL;
+}
+
+
+/* sizes the buffer for whole frames and skips to the first one. */
+static const char *start_stream(rs_hnd_t *rh, int window, const VSAPI *vsapi)
+{
+    stream_t *st = rh->stream;
+    size_t capacity = (size_t)rh->frame_size + Y4M_MAX_FRAME_HEADER;
+    uint8_t *buff = (uint8_t *)realloc(st->buff, capacity + FRAME_PADDING);
+    if (!buff) {
+        return "failed to allocate stream buffer";
+    }
+    st->buff = buff;
+    st->capacity = capacity;
+
+    st->slots = (stream_slot_t *)calloc(window, sizeof(stream_slot_t));
+    if (!st->slots) {
+        return "failed to allocate stream window";
+    }
+    st->window = window;
+    st->vsapi = vsapi;
+    for (int i = 0; i < window; i++) {
+        st->slots[i].frame = -1;
+    }
+
+    stream_skip(st, rh->fd, rh->off_header);
+    return NULL;
+}
+
+
+/* y4m frame headers may carry parameters, so their lengths vary and the
+   offsets have to be found by walking the headers. the file is read in
+   large blocks; when a frame does not fit in half a block, only a small
+   window around each header is read and the frame data is skipped.
+   stores the data offsets of the complete frames between *pos and
+   file_size into index, max_frames at most, and leaves *pos at the first
+   header which could not be used. returns the number of frames or -1. */
+static int scan_y4m(const rs_hnd_t *rh, int64_t *pos, int64_t file_size,
+                    int64_t *index, int max_frames)
+{
+    int64_t frame_size = rh->frame_size;
+    size_t block_size = Y4M_SCAN_BLOCK;
+    if (frame_size + Y4M_MAX_FRAME_HEADER > Y4M_SCAN_BLOCK / 2) {
+        block_size = Y4M_MAX_FRAME_HEADER;
+    }
+    uint8_t *buff = (uint8_t *)malloc(block_size);
+    if (!buff) {
+        return -1;
+    }
+
+    int64_t block_pos = 0;
+    int64_t block_end = 0;
+    int num_frames = 0;
+    while (num_frames < max_frames) {
+        int64_t header_end = *pos + Y4M_MAX_FRAME_HEADER;
+        if (header_end > file_size) {
+            header_end = file_size;
+        }
+        if (*pos < block_pos || header_end > block_end) {
+            int64_t length = file_size - *pos;
+            if (length > (int64_t)block_size) {
+                length = block_size;
+            }
+            if (length < 1 || rs_pread(rh->fd, buff, length, *pos) != length) {
+                break;
+            }
+            block_pos = *pos;
+            block_end = *pos + length;
+        }
+
+        const uint8_t *p = buff + (*pos - block_pos);
+        size_t avail = header_end - *pos;
+        if (avail < 6 || memcmp(p, "FRAME", 5) != 0 ||
+            (p[5] != ' ' && p[5] != '\n')) {
+            break;
+        }
+        const uint8_t *eol = memchr(p + 5, '\n', avail - 5);
+        if (!eol) {
+            break;
+        }
+        int64_t data = *pos + (eol - p) + 1;
+        if (data + frame_size > file_size) {
+            break;
+        }
+        index[num_frames++] = data;
+        *pos = data + frame_size;
+    }
+    free(buff);
+    return num_frames;
+}
+
+
+static int VS_CC index_y4m(rs_hnd_t *rh)
+{
+    /* every frame takes at least "FRAME\n" and its data. */
+    int64_t max_frames =
+        (rh->file_size - rh->off_header) / ((int64_t)rh->frame_size + 6);
+    if (max_frames > INT_MAX) {
+        max_frames = INT_MAX;
+    }
+    if (max_frames < 1) {
+        rh->vi[0].numFrames = 0;
+        return 0;
+    }
+
+    int64_t *index = (int64_t *)malloc(sizeof(int64_t) * max_frames);
+    if (!index) {
+        return -1;
+    }
+    int64_t pos = rh->off_header;
+    int num_frames = scan_y4m(rh, &pos, rh->file_size, index, (int)max_frames);
+    if (num_frames < 0) {
+        free(index);
+        return -1;
+    }
+
+    rh->index = index;
+    rh->vi[0].numFrames = num_frames;
+    return 0;
+}
+
+
+static int64_t rs_time_ms(void)
+{
+#ifdef _WIN32
+    return (int64_t)GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+
+static int64_t rs_file_size(rs_fd_t fd)
+{
+#ifdef _WIN32
+    LARGE_INTEGER length;
+    return GetFileSizeEx(fd, &length) ? length.QuadPart : -1;
+#else
+    struct stat st;
+    return fstat(fd, &st) == 0 ? st.st_size : -1;
+#endif
+}
+
+
+/* picks up the frames written since the last look. raw frames sit at fixed
+   offsets, y4m ones are scanned from where the previous scan stopped. */
+static void follow_update(const rs_hnd_t *rh, follower_t *f)
+{
+    int64_t file_size = rs_file_size(rh->fd);
+    if (file_size <= f->file_size) {
+        return;
+    }
+    f->file_size = file_size;
+
+    if (!rh->is_y4m) {
+        int64_t frames =
+            (file_size - rh->off_header) / (rh->off_frame + rh->frame_size);
+        f->num_indexed = frames > INT_MAX ? INT_MAX : (int)frames;
+        return;
+    }
+
+    int64_t room = (file_size - f->scan_pos) / ((int64_t)rh->frame_size + 6);
+    if (room > INT_MAX - f->num_indexed) {
+        room = INT_MAX - f->num_indexed;
+    }
+    if (room < 1) {
+        return;
+    }
+    if (f->num_indexed + room > f->capacity) {
+        int64_t capacity = f->capacity * 2;
+        if (capacity < f->num_indexed + room) {
+            capacity = f->num_indexed + room;
+        }
+        if (capacity > INT_MAX) {
+            capacity = INT_MAX;
+        }
+        int64_t *index =
+            (int64_t *)realloc(f->index, sizeof(int64_t) * capacity);
+        if (!index) {
+            return;
+        }
+        f->index = index;
+        f->capacity = (int)capacity;
+    }
+    int found = scan_y4m(rh, &f->scan_pos, file_size,
+                         f->index + f->num_indexed, (int)room);
+    if (found > 0) {
+        f->num_indexed += found;
+    }
+}
+
+
+/* sleeps until the file may have grown or ms have passed. inotify wakes
+   the waiters early, the timeout only covers events drained by another
+   waiter. */
+static void follow_wait(follower_t *f, int64_t ms)
+{
+#ifdef HAVE_INOTIFY
+    if (f->notify_fd >= 0) {
+        struct pollfd pfd = { f->notify_fd, POLLIN, 0 };
+        if (poll(&pfd, 1, (int)(ms < FOLLOW_NOTIFY_MS ? ms : FOLLOW_NOTIFY_MS)) > 0) {
+            char events[4096];
+            while (read(f->notify_fd, events, sizeof events) > 0);
+        }
+        return;
+    }
+#endif
+    if (ms > FOLLOW_POLL_MS) {
+        ms = FOLLOW_POLL_MS;
+    }
+#ifdef _WIN32
+    Sleep((DWORD)ms);
+#else
+    struct timespec ts = { 0, (long)ms * 1000000 };
+    nanosleep(&ts, NULL);
+#endif
+}
+
+
+/* finds the offset of frame n, waiting up to the timeout for the file to
+   grow when the frame has not been written yet. */
+static const char *follow_frame(const rs_hnd_t *rh, int n, int64_t *pos)
+{
+    follower_t *f = rh->follow;
+    int64_t deadline = rs_time_ms() + f->timeout;
+
+    rs_mutex_lock(&f->mutex);
+    while (n >= f->num_indexed) {
+        follow_update(rh, f);
+        if (n < f->num_indexed) {
+            break;
+        }
+        int64_t left = deadline - rs_time_ms();
+        if (left <= 0) {
+            rs_mutex_unlock(&f->mutex);
+            return "raws: timed out waiting for the frame to be written";
+        }
+        rs_mutex_unlock(&f->mutex);
+        follow_wait(f, left);
+        rs_mutex_lock(&f->mutex);
+    }
+    if (rh->is_y4m) {
+        *pos = f->index[n];
+    } else {
+        *pos = rh->off_header + (int64_t)n * (rh->off_frame + rh->frame_size) +
+               rh->off_frame;
+    }
+    rs_mutex_unlock(&f->mutex);
+    return NULL;
+}
+
+
+static void stop_follow(rs_hnd_t *rh)
+{
+    follower_t *f = rh->follow;
+    if (!f) {
+        return;
+    }
+#ifdef HAVE_INOTIFY
+    if (f->notify_fd >= 0) {
+        close(f->notify_fd);
+    }
+#endif
+    rs_mutex_destroy(&f->mutex);
+    free(f->index);
+    free(f);
+    rh->follow = NULL;
+}
+
+
+static const char *start_follow(rs_hnd_t *rh, const char *src_name, int timeout)
+{
+    follower_t *f = (follower_t *)calloc(1, sizeof(follower_t));
+    if (!f) {
+        return "failed to allocate follower";
+    }
+    rs_mutex_init(&f->mutex);
+    f->timeout = timeout;
+    f->notify_fd = -1;
+    f->scan_pos = rh->off_header;
+    rh->follow = f;
+
+#ifdef HAVE_INOTIFY
+    f->notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (f->notify_fd >= 0 &&
+        inotify_add_watch(f->notify_fd, src_name, IN_MODIFY | IN_CLOSE_WRITE) < 0) {
+        close(f->notify_fd);
+        f->notify_fd = -1;
+    }
+#endif
+
+    follow_update(rh, f);
+    return NULL;
+}
+
+
+/* a sidecar index keeps the offsets found by index_y4m so that reopening
+   the same file does not scan it again. it is only trusted while the size,
+   mtime and stream header of the source are unchanged, and while its
+   offsets still look like frames of the source. */
+typedef struct {
+    char magic[8];
+    int64_t file_size;
+    int64_t mtime;
+    uint64_t header_hash;
+    uint32_t frame_size;
+    int32_t num_frames;
+} index_header_t;
+
+
+/* maps a whole file read-only. the mapping outlives the file handle. */
+static void *map_file(const char *path, size_t *size)
+{
+    rs_fd_t fd = rs_open(path, 0);
+    if (fd == RS_INVALID_FD) {
+        return NULL;
+    }
+
+    void *map = NULL;
+#ifdef _WIN32
+    LARGE_INTEGER length;
+    if (GetFileSizeEx(fd, &length) && length.QuadPart > 0 &&
+        (uint64_t)length.QuadPart <= SIZE_MAX) {
+        HANDLE hnd = CreateFileMapping(fd, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (hnd) {
+            map = MapViewOfFile(hnd, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(hnd);
+            *size = (size_t)length.QuadPart;
+        }
+    }
+    CloseHandle(fd);
+#else
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 &&
+        (uint64_t)st.st_size <= SIZE_MAX) {
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            map = NULL;
         }
-        dstp0 += dst_stride;
-        dstp1 += dst_stride;
+        *size = (size_t)st.st_size;
     }
+    close(fd);
+#endif
+    return map;
 }
 
 
-static void VS_CC
-write_packed_rgb24(rs_hnd_t *rh, VSFrameRef **dst, const VSAPI *vsapi,
-                   VSCore *core)
+static void unmap_file(void *map, size_t size)
 {
-    struct rgb24_t {
-        uint8_t c[12];
-    };
+#ifdef _WIN32
+    UnmapViewOfFile(map);
+#else
+    munmap(map, size);
+#endif
+}
 
-    uint8_t *srcp_orig = rh->frame_buff;
-    int row_size = (rh->vi[0].width + 3) >> 2;
-    int height = rh->vi[0].height;
-    int src_stride = (rh->vi[0].width * 3 + rh->row_adjust) & (~rh->row_adjust);
 
-    uint8_t *dstp0_orig = vsapi->getWritePtr(dst[0], rh->order[0]);
-    uint8_t *dstp1_orig = vsapi->getWritePtr(dst[0], rh->order[1]);
-    uint8_t *dstp2_orig = vsapi->getWritePtr(dst[0], rh->order[2]);
-    int dst_stride = vsapi->getStride(dst[0], 0);
+static uint64_t hash_header(const rs_hnd_t *rh)
+{
+    uint8_t buff[256];
+    size_t length = rh->off_header;
+    if (length > sizeof buff) {
+        length = sizeof buff;
+    }
+    if (rs_pread(rh->fd, buff, length, 0) != (int64_t)length) {
+        return 0;
+    }
 
-    for (int y = 0; y < height; y++) {
-        struct rgb24_t *srcp = (struct rgb24_t *)(srcp_orig + y * src_stride);
-        uint32_t *dstp0 = (uint32_t *)(dstp0_orig + y * dst_stride);
-        uint32_t *dstp1 = (uint32_t *)(dstp1_orig + y * dst_stride);
-        uint32_t *dstp2 = (uint32_t *)(dstp2_orig + y * dst_stride);
-        for (int x = 0; x < row_size; x++) {
-            dstp0[x] = bitor8to32(srcp[x].c[9], srcp[x].c[6],
-                                  srcp[x].c[3], srcp[x].c[0]);
-            dstp1[x] = bitor8to32(srcp[x].c[10], srcp[x].c[7],
-                                  srcp[x].c[4], srcp[x].c[1]);
-            dstp2[x] = bitor8to32(srcp[x].c[11], srcp[x].c[8],
-                                  srcp[x].c[5], srcp[x].c[2]);
-        }
+    /* FNV-1a */
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ buff[i]) * 0x100000001b3ULL;
     }
+    return hash;
 }
 
 
-static void VS_CC
-write_packed_rgb48(rs_hnd_t *rh, VSFrameRef **dst, const VSAPI *vsapi,
-                   VSCore *core)
+/* a bounded sample of the offsets, the first and last ones included, must
+   pass index_pos and follow the end of a line in the source. */
+static int check_index(const rs_hnd_t *rh)
 {
-    struct rgb48_t {
-        uint16_t c[3];
-    };
-
-    uint8_t *srcp_orig = rh->frame_buff;
-    int src_stride = (rh->vi[0].width * 6 + rh->row_adjust) & (~rh->row_adjust);
-    int width = rh->vi[0].width;
-    int height = rh->vi[0].height;
-
-    uint16_t *dstp0 = (uint16_t *)vsapi->getWritePtr(dst[0], rh->order[0]);
-    uint16_t *dstp1 = (uint16_t *)vsapi->getWritePtr(dst[0], rh->order[1]);
-    uint16_t *dstp2 = (uint16_t *)vsapi->getWritePtr(dst[0], rh->order[2]);
-    int stride = vsapi->getStride(dst[0], 0) >> 1;;
-
-    for (int y = 0; y < height; y++) {
-        struct rgb48_t *srcp = (struct rgb48_t *)(srcp_orig + y * src_stride);
-        for (int x = 0; x < width; x++) {
-            dstp0[x] = srcp[x].c[0];
-            dstp1[x] = srcp[x].c[1];
-            dstp2[x] = srcp[x].c[2];
+    int num_frames = rh->vi[0].numFrames;
+    int num_samples = num_frames < INDEX_SAMPLES ? num_frames : INDEX_SAMPLES;
+    for (int i = 0; i < num_samples; i++) {
+        int n = num_samples > 1 ?
+                (int)((int64_t)i * (num_frames - 1) / (num_samples - 1)) : 0;
+        int64_t pos = index_pos(rh, n);
+        uint8_t c;
+        if (pos < 0 || rs_pread(rh->fd, &c, 1, pos - 1) != 1 || c != '\n') {
+            return -1;
         }
-        dstp0 += stride;
-        dstp1 += stride;
-        dstp2 += stride;
     }
+    return 0;
 }
 
 
-static void VS_CC
-write_packed_rgb32(rs_hnd_t *rh, VSFrameRef **dst, const VSAPI *vsapi,
-                   VSCore *core)
+static int load_index(rs_hnd_t *rh, const char *path, uint64_t hash)
 {
-    struct rgb32_t {
-        uint8_t c[16];
-    };
-
-    uint8_t *srcp_orig = rh->frame_buff;
-    int src_stride = ((rh->vi[0].width << 2) + rh->row_adjust) & (~rh->row_adjust);
-    int row_size = (rh->vi[0].width + 3) >> 2;
-    int height = rh->vi[0].height;
-
-    int *order = rh->order;
-
-    dst[1] = vsapi->newVideoFrame(rh->vi[1].format, rh->vi[1].width,
-                                  rh->vi[1].height, NULL, core);
+    size_t size;
+    uint8_t *map = (uint8_t *)map_file(path, &size);
+    if (!map) {
+        return -1;
+    }
 
-    uint32_t *dstp[4];
-    for (int i = 0; i < 3; i++) {
-        dstp[i] = (uint32_t *)vsapi->getWritePtr(dst[0], i);
+    const index_header_t *hdr = (const index_header_t *)map;
+    if (size < sizeof(index_header_t) ||
+        memcmp(hdr->magic, INDEX_MAGIC, sizeof hdr->magic) != 0 ||
+        hdr->file_size != rh->file_size || hdr->mtime != rh->mtime ||
+        hdr->header_hash != hash || hdr->frame_size != rh->frame_size ||
+        hdr->num_frames < 1 ||
+        size != sizeof(index_header_t) + sizeof(int64_t) * hdr->num_frames) {
+        unmap_file(map, size);
+        return -1;
     }
-    dstp[3] = (uint32_t *)vsapi->getWritePtr(dst[1], 0);
-    int dst_stride = vsapi->getStride(dst[0], 0) >> 2;
 
-    for (int y = 0; y < height; y++) {
-        struct rgb32_t *srcp = (struct rgb32_t *)(srcp_orig + y * src_stride);
-        for (int x = 0; x < row_size; x++) {
-            *(dstp[order[0]] + x) = bitor8to32(srcp[x].c[12], srcp[x].c[8],
-                                               srcp[x].c[4], srcp[x].c[0]);
-            *(dstp[order[1]] + x) = bitor8to32(srcp[x].c[13], srcp[x].c[9],
-                                               srcp[x].c[5], srcp[x].c[1]);
-            *(dstp[order[2]] + x) = bitor8to32(srcp[x].c[14], srcp[x].c[10],
-                                               srcp[x].c[6], srcp[x].c[2]);
-            *(dstp[order[3]] + x) = bitor8to32(srcp[x].c[15], srcp[x].c[11],
-                                               srcp[x].c[7], srcp[x].c[3]);
-        }
-        for (int i = 0; i < 4; i++) {
-            dstp[i] += dst_stride;
-        }
+    rh->index_map = map;
+    rh->index_map_size = size;
+    rh->index = (int64_t *)(map + sizeof(index_header_t));
+    rh->vi[0].numFrames = hdr->num_frames;
+    if (check_index(rh) != 0) {
+        unmap_file(map, size);
+        rh->index_map = NULL;
+        rh->index = NULL;
+        rh->vi[0].numFrames = 0;
+        return -1;
     }
+    return 0;
 }
 
 
-static void VS_CC
-write_packed_yuv422(rs_hnd_t *rh, VSFrameRef **dst, const VSAPI *vsapi,
-                    VSCore *core)
+/* failures are ignored: the sidecar is only a shortcut for the next open.
+   it is written under a temporary name and renamed so that a concurrent
+   open never maps a partial file. */
+static void save_index(const rs_hnd_t *rh, const char *path, uint64_t hash)
 {
-    struct packed422_t {
-        uint8_t c[4];
-    };
+    int num_frames = rh->vi[0].numFrames;
+    if (num_frames < 1) {
+        return;
+    }
 
-    uint8_t *srcp_orig = rh->frame_buff;
-    int src_stride = ((rh->vi[0].width << 1) + rh->row_adjust) & (~rh->row_adjust);
-    int width = rh->vi[0].width >> 1;
-    int height = rh->vi[0].height;
-    int o0 = rh->order[0];
-    int o1 = rh->order[1];
-    int o2 = rh->order[2];
-    int o3 = rh->order[3];
-
-    uint8_t *dstp[3];
-    int padding[3];
-    for (int i = 0; i < 3; i++) {
-        dstp[i] = vsapi->getWritePtr(dst[0], i);
-        padding[i] = vsapi->getStride(dst[0], i) - vsapi->getFrameWidth(dst[0], i);
+    char tmp_path[FILENAME_MAX * 4];
+    if (snprintf(tmp_path, sizeof tmp_path, "%s.tmp", path) >=
+        (int)sizeof tmp_path) {
+        return;
     }
 
-    for (int y = 0; y < height; y++) {
-        struct packed422_t *srcp = (struct packed422_t *)(srcp_orig + y * src_stride);
-        for (int x = 0; x < width; x++) {
-            *(dstp[o0]++) = srcp[x].c[0];
-            *(dstp[o1]++) = srcp[x].c[1];
-            *(dstp[o2]++) = srcp[x].c[2];
-            *(dstp[o3]++) = srcp[x].c[3];
-        }
-        dstp[0] += padding[0];
-        dstp[1] += padding[1];
-        dstp[2] += padding[2];
+    index_header_t hdr = { { 0 } };
+    memcpy(hdr.magic, INDEX_MAGIC, sizeof hdr.magic);
+    hdr.file_size = rh->file_size;
+    hdr.mtime = rh->mtime;
+    hdr.header_hash = hash;
+    hdr.frame_size = rh->frame_size;
+    hdr.num_frames = num_frames;
+
+#ifdef _WIN32
+    wchar_t wtmp[FILENAME_MAX * 4];
+    wchar_t wpath[FILENAME_MAX * 4];
+    MultiByteToWideChar(CP_UTF8, 0, tmp_path, -1, wtmp, FILENAME_MAX * 4);
+    MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, FILENAME_MAX * 4);
+    FILE *fp = _wfopen(wtmp, L"wb");
+#else
+    FILE *fp = fopen(tmp_path, "wb");
+#endif
+    if (!fp) {
+        return;
     }
+    int ok = fwrite(&hdr, sizeof hdr, 1, fp) == 1 &&
+             fwrite(rh->index, sizeof(int64_t), num_frames, fp) ==
+                 (size_t)num_frames;
+    ok = fclose(fp) == 0 && ok;
+
+#ifdef _WIN32
+    if (!ok || !MoveFileExW(wtmp, wpath, MOVEFILE_REPLACE_EXISTING)) {
+        _wremove(wtmp);
+    }
+#else
+    if (!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+    }
+#endif
 }
 
 
-static int VS_CC create_index(rs_hnd_t *rh)
+/* index_path names the sidecar of a y4m source, NULL disables it. */
+static int VS_CC create_index(rs_hnd_t *rh, const char *index_path)
 {
-    int num_frames = rh->vi[0].numFrames;
+    if (rh->is_y4m) {
+        if (!index_path) {
+            return index_y4m(rh);
+        }
+        uint64_t hash = hash_header(rh);
+        if (load_index(rh, index_path, hash) == 0) {
+            return 0;
+        }
+        if (index_y4m(rh) < 0) {
+            return -1;
+        }
+        save_index(rh, index_path, hash);
+        return 0;
+    }
+
+    int64_t frames =
+        (rh->file_size - rh->off_header) / (rh->off_frame + rh->frame_size);
+    int num_frames = frames > INT_MAX ? INT_MAX : (int)frames;
+    rh->vi[0].numFrames = num_frames;
+    if (num_frames < 1) {
+        return 0;
+    }
 
     int64_t *index = (int64_t *)malloc(sizeof(int64_t) * num_frames);
     if (!index) {
@@ -440,13 +2578,13 @@ static inline const char * VS_CC get_format(char *ctag)
 static int VS_CC check_y4m(rs_hnd_t *rh)
 {
     const char *stream_header = "YUV4MPEG2";
-    const char *frame_header = "FRAME\n";
+    const char *frame_header = "FRAME";
     size_t sh_length = strlen(stream_header);
     size_t fh_length = strlen(frame_header);
     char buff[256] = { 0 };
     char ctag[32] = { 0 };
 
-    fread(buff, 1, sizeof buff, rh->file);
+    read_header(rh, buff, sizeof buff, 0);
     if (strncmp(buff, stream_header, sh_length) != 0) {
         return 1;
     }
@@ -481,7 +2619,7 @@ static int VS_CC check_y4m(rs_hnd_t *rh)
         }
         if (!strncmp(buff + i, " C", 2)) {
             i += 2;
-            sscanf(buff + i, "%s", ctag);
+            sscanf(buff + i, "%31s", ctag);
             strcpy(rh->src_format, get_format(ctag));
         }
         if (i == sizeof buff - 1) {
@@ -491,11 +2629,15 @@ static int VS_CC check_y4m(rs_hnd_t *rh)
 
     rh->off_header = ++i;
 
-    if (strncmp(buff + i, frame_header, strlen(frame_header)) != 0) {
+    /* frame parameters are allowed, create_index finds each header end. */
+    if (i + fh_length >= sizeof buff ||
+        strncmp(buff + i, frame_header, fh_length) != 0 ||
+        (buff[i + fh_length] != ' ' && buff[i + fh_length] != '\n')) {
         return -2;
     }
 
-    rh->off_frame = fh_length;
+    rh->off_frame = fh_length + 1;
+    rh->is_y4m = 1;
 
     if (strlen(rh->src_format) == 0) {
         strcpy(rh->src_format, "YUV420P8");
@@ -518,9 +2660,8 @@ static int check_bmp(rs_hnd_t *rh)
     uint32_t offset_data;
     bmp_info_header_t info = { 0 };
 
-    fseek(rh->file, 10, SEEK_SET);
-    fread(&offset_data, 1, sizeof(uint32_t), rh->file);
-    fread(&info, 1, sizeof(bmp_info_header_t), rh->file);
+    read_header(rh, &offset_data, sizeof(uint32_t), 10);
+    read_header(rh, &info, sizeof(bmp_info_header_t), 14);
 
     if (info.num_planes != 1 || info.fourcc != 0 ||
         (info.bits_per_pixel != 24 && info.bits_per_pixel != 32)) {
@@ -539,9 +2680,8 @@ static int check_bmp(rs_hnd_t *rh)
 
 static int check_header(rs_hnd_t *rh)
 {
-    char head[2];
-    fread(head, 1, 2, rh->file);
-    fseek(rh->file, 0, SEEK_SET);
+    char head[2] = { 0 };
+    read_header(rh, head, 2, 0);
 
     if (head[0] == 'B' && head[1] == 'M') {
         return check_bmp(rh);
@@ -555,8 +2695,275 @@ static int check_header(rs_hnd_t *rh)
 }
 
 
+/* a name with a single %d style conversion, optionally zero padded, and
+   no other conversion than %% names a numbered sequence of files. */
+static int is_seq_pattern(const char *name)
+{
+    int conversions = 0;
+    for (const char *p = name; *p; p++) {
+        if (*p != '%') {
+            continue;
+        }
+        p++;
+        if (*p == '%') {
+            continue;
+        }
+        while (*p >= '0' && *p <= '9') {
+            p++;
+        }
+        if (*p != 'd') {
+            return 0;
+        }
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+
+static int file_exists(const char *name, int64_t *size)
+{
+#ifdef _WIN32
+    struct _stat64 st;
+    wchar_t tmp[FILENAME_MAX * 4];
+    MultiByteToWideChar(CP_UTF8, 0, name, -1, tmp, FILENAME_MAX * 4);
+    if (_wstat64(tmp, &st) != 0) {
+        return 0;
+    }
+#else
+    struct stat st;
+    if (stat(name, &st) != 0) {
+        return 0;
+    }
+#endif
+    if (size) {
+        *size = st.st_size;
+    }
+    return 1;
+}
+
+
+static int add_segment(sequence_t *sq, const char *path)
+{
+    if (sq->num_segments == sq->capacity) {
+        int capacity = sq->capacity ? sq->capacity * 2 : 64;
+        segment_t *segments =
+            (segment_t *)realloc(sq->segments, sizeof(segment_t) * capacity);
+        if (!segments) {
+            return -1;
+        }
+        sq->segments = segments;
+        sq->capacity = capacity;
+    }
+    segment_t *seg = sq->segments + sq->num_segments;
+    memset(seg, 0, sizeof *seg);
+    seg->path = (char *)malloc(strlen(path) + 1);
+    if (!seg->path) {
+        return -1;
+    }
+    strcpy(seg->path, path);
+    sq->num_segments++;
+    return 0;
+}
+
+
+static void stop_sequence(rs_hnd_t *rh)
+{
+    sequence_t *sq = rh->seq;
+    if (!sq) {
+        return;
+    }
+    for (int i = 0; i < sq->num_segments; i++) {
+        free(sq->segments[i].path);
+    }
+    rs_fd_pool_put(sq->files);
+    rs_mutex_destroy(&sq->mutex);
+    free(sq->segments);
+    free(sq);
+    rh->seq = NULL;
+}
+
+
+/* collects the file names of a list, or of a pattern expanded from
+   start_number (the first of 0 to 4 which exists when negative) up to the
+   first missing number. nothing is opened here, the files are read
+   through the pool shared by all sources of the core. */
+static const char *
+start_sequence(rs_hnd_t *rh, const VSMap *in, VSCore *core, const VSAPI *vsapi,
+               int start_number, int max_open)
+{
+    sequence_t *sq = (sequence_t *)calloc(1, sizeof(sequence_t));
+    if (!sq) {
+        return "failed to allocate sequence";
+    }
+    rs_mutex_init(&sq->mutex);
+    rh->seq = sq;
+    sq->files = rs_fd_pool_get(core, max_open);
+    if (!sq->files) {
+        return "failed to allocate file pool";
+    }
+
+    int num_sources = vsapi->propNumElements(in, "source");
+    if (num_sources > 1) {
+        for (int i = 0; i < num_sources; i++) {
+            if (add_segment(sq, vsapi->propGetData(in, "source", i, 0)) < 0) {
+                return "failed to allocate sequence";
+            }
+        }
+        return NULL;
+    }
+
+    const char *pattern = vsapi->propGetData(in, "source", 0, 0);
+    char path[FILENAME_MAX * 4];
+    int number = start_number;
+    if (number < 0) {
+        for (number = 0; number < 5; number++) {
+            snprintf(path, sizeof path, pattern, number);
+            if (file_exists(path, NULL)) {
+                break;
+            }
+        }
+    }
+    for (; number < INT_MAX; number++) {
+        if (snprintf(path, sizeof path, pattern, number) >= (int)sizeof path ||
+            !file_exists(path, NULL)) {
+            break;
+        }
+        if (add_segment(sq, path) < 0) {
+            return "failed to allocate sequence";
+        }
+    }
+    if (sq->num_segments == 0) {
+        return "no file matches the source pattern";
+    }
+    return NULL;
+}
+
+
+/* lays the frames of all files out one after another. raw files are
+   sized with stat, bitmaps hold one frame each and their headers are only
+   read when the frame is first requested. */
+static const char *index_sequence(rs_hnd_t *rh)
+{
+    sequence_t *sq = rh->seq;
+    int64_t total = 0;
+    for (int i = 0; i < sq->num_segments; i++) {
+        segment_t *seg = sq->segments + i;
+        seg->first_frame = (int)total;
+        if (sq->is_bmp) {
+            seg->num_frames = 1;
+            seg->data_offset = i == 0 ? rh->off_header : -1;
+        } else {
+            int64_t size;
+            if (!file_exists(seg->path, &size)) {
+                return "a file of the sequence does not exist";
+            }
+            int64_t frames =
+                (size - rh->off_header) / (rh->off_frame + rh->frame_size);
+            seg->num_frames = frames < 0 ? 0 : (int)(frames > INT_MAX ? INT_MAX : frames);
+            seg->data_offset = rh->off_header;
+        }
+        total += seg->num_frames;
+        if (total > INT_MAX) {
+            return "too many frames in the sequence";
+        }
+    }
+    rh->vi[0].numFrames = (int)total;
+    return NULL;
+}
+
+
+static segment_t *seq_find(const sequence_t *sq, int n)
+{
+    int lo = 0, hi = sq->num_segments - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (sq->segments[mid].first_frame <= n) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return sq->segments + lo;
+}
+
+
+/* bitmap headers are read when their file is first used. two requests
+   may both parse the same header, which is harmless. */
+static const char *
+seq_parse_bmp(const rs_hnd_t *rh, sequence_t *sq, segment_t *seg, rs_fd_t fd,
+              int64_t *data_offset)
+{
+    char magic[2] = { 0 };
+    uint32_t offset_data = 0;
+    bmp_info_header_t info = { 0 };
+    rs_pread(fd, magic, 2, 0);
+    rs_pread(fd, &offset_data, sizeof(uint32_t), 10);
+    rs_pread(fd, &info, sizeof(bmp_info_header_t), 14);
+    if (magic[0] != 'B' || magic[1] != 'M' || info.num_planes != 1 ||
+        info.fourcc != 0 || abs_i(info.width) != rh->src_width ||
+        abs_i(info.height) != rh->src_height ||
+        info.bits_per_pixel != (rh->has_alpha ? 32 : 24)) {
+        return "raws: a bitmap of the sequence differs from the first one";
+    }
+    rs_mutex_lock(&sq->mutex);
+    seg->data_offset = offset_data;
+    rs_mutex_unlock(&sq->mutex);
+    *data_offset = offset_data;
+    return NULL;
+}
+
+
+static const uint8_t *
+seq_read_frame(const rs_hnd_t *rh, int n, uint8_t *buff, const char **err)
+{
+    sequence_t *sq = rh->seq;
+    segment_t *seg = seq_find(sq, n);
+
+    rs_fd_t fd;
+    rs_fd_entry_t *file = rs_fd_pool_acquire(sq->files, seg->path, &fd);
+    if (!file) {
+        *err = "raws: failed to open a file of the sequence";
+        return NULL;
+    }
+
+    rs_mutex_lock(&sq->mutex);
+    int64_t data_offset = seg->data_offset;
+    rs_mutex_unlock(&sq->mutex);
+    if (data_offset < 0) {
+        *err = seq_parse_bmp(rh, sq, seg, fd, &data_offset);
+        if (*err) {
+            rs_fd_pool_release(sq->files, file);
+            return NULL;
+        }
+    }
+
+    int64_t pos = data_offset + rh->off_frame +
+                  (int64_t)(n - seg->first_frame) * (rh->off_frame + rh->frame_size);
+    int64_t done = rs_pread(fd, buff, rh->frame_size, pos);
+    rs_fd_pool_release(sq->files, file);
+
+    if (done < rh->frame_size) {
+        *err = "raws: failed to read frame";
+        return NULL;
+    }
+    return buff;
+}
+
+
 static const char * VS_CC check_args(rs_hnd_t *rh, vs_args_t *va)
 {
+    /* a BE or LE suffix selects the byte order of the formats with samples
+       of 16 bits or more, which are little-endian without one. */
+    char name[FORMAT_MAX_LEN];
+    int big_endian = 0;
+    snprintf(name, sizeof name, "%s", rh->src_format);
+    size_t len = strlen(name);
+    if (len > 2 && (strcasecmp(name + len - 2, "BE") == 0 ||
+                    strcasecmp(name + len - 2, "LE") == 0)) {
+        big_endian = name[len - 2] == 'B' || name[len - 2] == 'b';
+        name[len - 2] = '\0';
+    }
+
     const struct {
         char *format_name;
         int subsample_h;
@@ -566,73 +2973,74 @@ static const char * VS_CC check_args(rs_hnd_t *rh, vs_args_t *va)
         int has_alpha;
         int order[4];
         VSPresetFormat vsformat;
-        func_write_frame func;
+        func_layout_frame func;
+        unpack_kind_t unpack;
     } table[] = {
-        { "i420",      2, 2, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV420P8,  write_planar_frame  },
-        { "IYUV",      2, 2, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV420P8,  write_planar_frame  },
-        { "YV12",      2, 2, 3, 1, 0, { 0, 2, 1, 9 }, pfYUV420P8,  write_planar_frame  },
-        { "YUV420P8",  2, 2, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV420P8,  write_planar_frame  },
-        { "i422",      2, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV422P8,  write_planar_frame  },
-        { "YV16",      2, 1, 3, 1, 0, { 0, 2, 1, 9 }, pfYUV422P8,  write_planar_frame  },
-        { "YUV422P8",  2, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV422P8,  write_planar_frame  },
-        { "i444",      1, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV444P8,  write_planar_frame  },
-        { "YV24",      1, 1, 3, 1, 0, { 0, 2, 1, 9 }, pfYUV444P8,  write_planar_frame  },
-        { "YUV444P8",  1, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV444P8,  write_planar_frame  },
-        { "Y8",        1, 1, 1, 1, 0, { 0, 9, 9, 9 }, pfGray8,     write_planar_frame  },
-        { "Y800",      1, 1, 1, 1, 0, { 0, 9, 9, 9 }, pfGray8,     write_planar_frame  },
-        { "GRAY",      1, 1, 1, 1, 0, { 0, 9, 9, 9 }, pfGray8,     write_planar_frame  },
-        { "GRAY16",    1, 1, 1, 2, 0, { 0, 9, 9, 9 }, pfGray16,    write_planar_frame  },
-        { "GRAYH",     1, 1, 1, 2, 0, { 0, 9, 9, 9 }, pfGrayH,     write_planar_frame  },
-        { "GRAYS",     1, 1, 1, 4, 0, { 0, 9, 9, 9 }, pfGrayS,     write_planar_frame  },
-        { "YV411",     4, 1, 3, 1, 0, { 0, 2, 1, 9 }, pfYUV444P8,  write_planar_frame  },
-        { "YUV411P8",  4, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV411P8,  write_planar_frame  },
-        { "YUV9",      4, 4, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV410P8,  write_planar_frame  },
-        { "YVU9",      4, 4, 3, 1, 0, { 0, 2, 1, 9 }, pfYUV410P8,  write_planar_frame  },
-        { "YUV410P8",  4, 4, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV410P8,  write_planar_frame  },
-        { "YUV440P8",  1, 2, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV440P8,  write_planar_frame  },
-        { "YUV420P9",  2, 2, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV420P9,  write_planar_frame  },
-        { "YUV420P10", 2, 2, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV420P10, write_planar_frame  },
-        { "YUV420P16", 2, 2, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV420P16, write_planar_frame  },
-        { "YUV422P9",  2, 2, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV422P9,  write_planar_frame  },
-        { "YUV422P10", 2, 2, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV422P10, write_planar_frame  },
-        { "YUV422P16", 2, 2, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV422P16, write_planar_frame  },
-        { "YUV444P9",  2, 2, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV444P9,  write_planar_frame  },
-        { "YUV444P10", 2, 2, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV444P10, write_planar_frame  },
-        { "YUV444P16", 2, 2, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV444P16, write_planar_frame  },
-        { "YUV444P8A", 1, 1, 4, 1, 1, { 0, 1, 2, 3 }, pfYUV444P8,  write_planar_frame  },
-        { "YUY2",      2, 1, 1, 4, 0, { 0, 1, 0, 2 }, pfYUV422P8,  write_packed_yuv422 },
-        { "YUYV",      2, 1, 1, 4, 0, { 0, 1, 0, 2 }, pfYUV422P8,  write_packed_yuv422 },
-        { "UYVY",      2, 1, 1, 4, 0, { 1, 0, 2, 0 }, pfYUV422P8,  write_packed_yuv422 },
-        { "YVYU",      2, 1, 1, 4, 0, { 0, 1, 0, 2 }, pfYUV422P8,  write_packed_yuv422 },
-        { "VYUY",      2, 1, 1, 4, 0, { 2, 0, 1, 0 }, pfYUV422P8,  write_packed_yuv422 },
-        { "BGR",       1, 1, 1, 3, 0, { 2, 1, 0, 9 }, pfRGB24,     write_packed_rgb24  },
-        { "RGB",       1, 1, 1, 3, 0, { 0, 1, 2, 9 }, pfRGB24,     write_packed_rgb24  },
-        { "BGRA",      1, 1, 1, 4, 1, { 2, 1, 0, 3 }, pfRGB24,     write_packed_rgb32  },
-        { "ABGR",      1, 1, 1, 4, 1, { 3, 2, 1, 0 }, pfRGB24,     write_packed_rgb32  },
-        { "RGBA",      1, 1, 1, 4, 1, { 0, 1, 2, 3 }, pfRGB24,     write_packed_rgb32  },
-        { "ARGB",      1, 1, 1, 4, 1, { 3, 0, 1, 2 }, pfRGB24,     write_packed_rgb32  },
-        { "AYUV",      1, 1, 1, 4, 1, { 3, 0, 1, 2 }, pfYUV444P8,  write_packed_rgb32  },
-        { "GBRP8",     1, 1, 3, 1, 0, { 1, 2, 0, 9 }, pfRGB24,     write_planar_frame  },
-        { "RGBP8",     1, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfRGB24,     write_planar_frame  },
-        { "GBRP9",     1, 1, 3, 2, 0, { 1, 2, 0, 9 }, pfRGB27,     write_planar_frame  },
-        { "RGBP9",     1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfRGB27,     write_planar_frame  },
-        { "GBRP10",    1, 1, 3, 2, 0, { 1, 2, 0, 9 }, pfRGB30,     write_planar_frame  },
-        { "RGBP10",    1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfRGB30,     write_planar_frame  },
-        { "GBRP16",    1, 1, 3, 2, 0, { 1, 2, 0, 9 }, pfRGB48,     write_planar_frame  },
-        { "RGBP16",    1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfRGB48,     write_planar_frame  },
-        { "BGR48",     1, 1, 3, 2, 0, { 2, 1, 0, 3 }, pfRGB48,     write_packed_rgb48  },
-        { "RGB48",     1, 1, 3, 2, 0, { 0, 1, 2, 3 }, pfRGB48,     write_packed_rgb48  },
-        { "NV12",      2, 2, 2, 1, 0, { 0, 1, 2, 9 }, pfYUV420P8,  write_nvxx_frame    },
-        { "NV21",      2, 2, 2, 1, 0, { 0, 2, 1, 9 }, pfYUV420P8,  write_nvxx_frame    },
-        { "P010",      2, 2, 2, 2, 0, { 0, 1, 2, 9 }, pfYUV420P16, write_px1x_frame    },
-        { "P016",      2, 2, 2, 2, 0, { 0, 1, 2, 9 }, pfYUV420P16, write_px1x_frame    },
-        { "P210",      2, 1, 2, 2, 0, { 0, 1, 2, 9 }, pfYUV422P16, write_px1x_frame    },
-        { "P216",      2, 1, 2, 2, 0, { 0, 1, 2, 9 }, pfYUV422P16, write_px1x_frame    },
-        { rh->src_format, 0 }
+        { "i420",      2, 2, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV420P8,  layout_planar_frame,  UNPACK_NONE      },
+        { "IYUV",      2, 2, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV420P8,  layout_planar_frame,  UNPACK_NONE      },
+        { "YV12",      2, 2, 3, 1, 0, { 0, 2, 1, 9 }, pfYUV420P8,  layout_planar_frame,  UNPACK_NONE      },
+        { "YUV420P8",  2, 2, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV420P8,  layout_planar_frame,  UNPACK_NONE      },
+        { "i422",      2, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV422P8,  layout_planar_frame,  UNPACK_NONE      },
+        { "YV16",      2, 1, 3, 1, 0, { 0, 2, 1, 9 }, pfYUV422P8,  layout_planar_frame,  UNPACK_NONE      },
+        { "YUV422P8",  2, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV422P8,  layout_planar_frame,  UNPACK_NONE      },
+        { "i444",      1, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV444P8,  layout_planar_frame,  UNPACK_NONE      },
+        { "YV24",      1, 1, 3, 1, 0, { 0, 2, 1, 9 }, pfYUV444P8,  layout_planar_frame,  UNPACK_NONE      },
+        { "YUV444P8",  1, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV444P8,  layout_planar_frame,  UNPACK_NONE      },
+        { "Y8",        1, 1, 1, 1, 0, { 0, 9, 9, 9 }, pfGray8,     layout_planar_frame,  UNPACK_NONE      },
+        { "Y800",      1, 1, 1, 1, 0, { 0, 9, 9, 9 }, pfGray8,     layout_planar_frame,  UNPACK_NONE      },
+        { "GRAY",      1, 1, 1, 1, 0, { 0, 9, 9, 9 }, pfGray8,     layout_planar_frame,  UNPACK_NONE      },
+        { "GRAY16",    1, 1, 1, 2, 0, { 0, 9, 9, 9 }, pfGray16,    layout_planar_frame,  UNPACK_NONE      },
+        { "GRAYH",     1, 1, 1, 2, 0, { 0, 9, 9, 9 }, pfGrayH,     layout_planar_frame,  UNPACK_NONE      },
+        { "GRAYS",     1, 1, 1, 4, 0, { 0, 9, 9, 9 }, pfGrayS,     layout_planar_frame,  UNPACK_NONE      },
+        { "YV411",     4, 1, 3, 1, 0, { 0, 2, 1, 9 }, pfYUV411P8,  layout_planar_frame,  UNPACK_NONE      },
+        { "YUV411P8",  4, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV411P8,  layout_planar_frame,  UNPACK_NONE      },
+        { "YUV9",      4, 4, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV410P8,  layout_planar_frame,  UNPACK_NONE      },
+        { "YVU9",      4, 4, 3, 1, 0, { 0, 2, 1, 9 }, pfYUV410P8,  layout_planar_frame,  UNPACK_NONE      },
+        { "YUV410P8",  4, 4, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV410P8,  layout_planar_frame,  UNPACK_NONE      },
+        { "YUV440P8",  1, 2, 3, 1, 0, { 0, 1, 2, 9 }, pfYUV440P8,  layout_planar_frame,  UNPACK_NONE      },
+        { "YUV420P9",  2, 2, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV420P9,  layout_planar_frame,  UNPACK_NONE      },
+        { "YUV420P10", 2, 2, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV420P10, layout_planar_frame,  UNPACK_NONE      },
+        { "YUV420P16", 2, 2, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV420P16, layout_planar_frame,  UNPACK_NONE      },
+        { "YUV422P9",  2, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV422P9,  layout_planar_frame,  UNPACK_NONE      },
+        { "YUV422P10", 2, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV422P10, layout_planar_frame,  UNPACK_NONE      },
+        { "YUV422P16", 2, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV422P16, layout_planar_frame,  UNPACK_NONE      },
+        { "YUV444P9",  1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV444P9,  layout_planar_frame,  UNPACK_NONE      },
+        { "YUV444P10", 1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV444P10, layout_planar_frame,  UNPACK_NONE      },
+        { "YUV444P16", 1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfYUV444P16, layout_planar_frame,  UNPACK_NONE      },
+        { "YUV444P8A", 1, 1, 4, 1, 1, { 0, 1, 2, 3 }, pfYUV444P8,  layout_planar_frame,  UNPACK_NONE      },
+        { "YUY2",      2, 1, 1, 2, 0, { 0, 1, 0, 2 }, pfYUV422P8,  layout_packed_yuv422, UNPACK_YUYV      },
+        { "YUYV",      2, 1, 1, 2, 0, { 0, 1, 0, 2 }, pfYUV422P8,  layout_packed_yuv422, UNPACK_YUYV      },
+        { "UYVY",      2, 1, 1, 2, 0, { 1, 0, 2, 0 }, pfYUV422P8,  layout_packed_yuv422, UNPACK_UYVY      },
+        { "YVYU",      2, 1, 1, 2, 0, { 0, 2, 0, 1 }, pfYUV422P8,  layout_packed_yuv422, UNPACK_YUYV      },
+        { "VYUY",      2, 1, 1, 2, 0, { 2, 0, 1, 0 }, pfYUV422P8,  layout_packed_yuv422, UNPACK_UYVY      },
+        { "BGR",       1, 1, 1, 3, 0, { 2, 1, 0, 9 }, pfRGB24,     layout_packed_rgb,    UNPACK_DEINT3_8  },
+        { "RGB",       1, 1, 1, 3, 0, { 0, 1, 2, 9 }, pfRGB24,     layout_packed_rgb,    UNPACK_DEINT3_8  },
+        { "BGRA",      1, 1, 1, 4, 1, { 2, 1, 0, 3 }, pfRGB24,     layout_packed_rgb,    UNPACK_DEINT4_8  },
+        { "ABGR",      1, 1, 1, 4, 1, { 3, 2, 1, 0 }, pfRGB24,     layout_packed_rgb,    UNPACK_DEINT4_8  },
+        { "RGBA",      1, 1, 1, 4, 1, { 0, 1, 2, 3 }, pfRGB24,     layout_packed_rgb,    UNPACK_DEINT4_8  },
+        { "ARGB",      1, 1, 1, 4, 1, { 3, 0, 1, 2 }, pfRGB24,     layout_packed_rgb,    UNPACK_DEINT4_8  },
+        { "AYUV",      1, 1, 1, 4, 1, { 3, 0, 1, 2 }, pfYUV444P8,  layout_packed_rgb,    UNPACK_DEINT4_8  },
+        { "GBRP8",     1, 1, 3, 1, 0, { 1, 2, 0, 9 }, pfRGB24,     layout_planar_frame,  UNPACK_NONE      },
+        { "RGBP8",     1, 1, 3, 1, 0, { 0, 1, 2, 9 }, pfRGB24,     layout_planar_frame,  UNPACK_NONE      },
+        { "GBRP9",     1, 1, 3, 2, 0, { 1, 2, 0, 9 }, pfRGB27,     layout_planar_frame,  UNPACK_NONE      },
+        { "RGBP9",     1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfRGB27,     layout_planar_frame,  UNPACK_NONE      },
+        { "GBRP10",    1, 1, 3, 2, 0, { 1, 2, 0, 9 }, pfRGB30,     layout_planar_frame,  UNPACK_NONE      },
+        { "RGBP10",    1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfRGB30,     layout_planar_frame,  UNPACK_NONE      },
+        { "GBRP16",    1, 1, 3, 2, 0, { 1, 2, 0, 9 }, pfRGB48,     layout_planar_frame,  UNPACK_NONE      },
+        { "RGBP16",    1, 1, 3, 2, 0, { 0, 1, 2, 9 }, pfRGB48,     layout_planar_frame,  UNPACK_NONE      },
+        { "BGR48",     1, 1, 1, 6, 0, { 2, 1, 0, 3 }, pfRGB48,     layout_packed_rgb,    UNPACK_DEINT3_16 },
+        { "RGB48",     1, 1, 1, 6, 0, { 0, 1, 2, 3 }, pfRGB48,     layout_packed_rgb,    UNPACK_DEINT3_16 },
+        { "NV12",      2, 2, 2, 1, 0, { 0, 1, 2, 9 }, pfYUV420P8,  layout_nvxx_frame,    UNPACK_DEINT2_8  },
+        { "NV21",      2, 2, 2, 1, 0, { 0, 2, 1, 9 }, pfYUV420P8,  layout_nvxx_frame,    UNPACK_DEINT2_8  },
+        { "P010",      2, 2, 2, 2, 0, { 0, 1, 2, 9 }, pfYUV420P16, layout_px1x_frame,    UNPACK_DEINT2_16 },
+        { "P016",      2, 2, 2, 2, 0, { 0, 1, 2, 9 }, pfYUV420P16, layout_px1x_frame,    UNPACK_DEINT2_16 },
+        { "P210",      2, 1, 2, 2, 0, { 0, 1, 2, 9 }, pfYUV422P16, layout_px1x_frame,    UNPACK_DEINT2_16 },
+        { "P216",      2, 1, 2, 2, 0, { 0, 1, 2, 9 }, pfYUV422P16, layout_px1x_frame,    UNPACK_DEINT2_16 },
+        { name, 0 }
     };
 
     int i = 0;
-    while (strcasecmp(rh->src_format, table[i].format_name) != 0) i++;
+    while (strcasecmp(name, table[i].format_name) != 0) i++;
     if (table[i].vsformat == 0) {
         return "unsupported format";
     }
@@ -644,10 +3052,12 @@ static const char * VS_CC check_args(rs_hnd_t *rh, vs_args_t *va)
     }
 
     int frame_size = 0;
+    rh->num_src_planes = table[i].num_planes;
     for (int p = 0; p < table[i].num_planes; p++) {
+        rh->plane_offset[p] = frame_size;
         int width_plane =
             (rh->vi[0].width / (p ? table[i].subsample_h : 1)) << (table[i].num_planes == 2 && p ? 1 : 0);
-        int height_plane = rh->vi[0].height / (p ? table[i].subsample_h : 1);
+        int height_plane = rh->vi[0].height / (p ? table[i].subsample_v : 1);
         int row_size_plane =
             (width_plane * table[i].bytes_per_row_sample + rh->row_adjust) & (~rh->row_adjust);
         frame_size += row_size_plane * height_plane;
@@ -655,8 +3065,26 @@ static const char * VS_CC check_args(rs_hnd_t *rh, vs_args_t *va)
     rh->frame_size = frame_size;
     rh->vi[0].format = va->vsapi->getFormatPreset(table[i].vsformat, va->core);
     memcpy(rh->order, table[i].order, sizeof(int) * 4);
-    rh->write_frame = table[i].func;
+    rh->layout_frame = table[i].func;
+    rh->unpack_kind = table[i].unpack;
     rh->has_alpha = table[i].has_alpha;
+    /* p010 and p210 keep 10 bits in the msbs of their 16 bit samples. */
+    rh->significant_bits = strcasecmp(name, "P010") == 0 ||
+                           strcasecmp(name, "P210") == 0 ?
+                           10 : rh->vi[0].format->bitsPerSample;
+
+    if (big_endian) {
+        int bps = rh->vi[0].format->bytesPerSample;
+        if (bps < 2) {
+            return "big-endian needs a format of 16 bits or more";
+        }
+        rh->swap_kind = bps == 2 ? UNPACK_SWAP16 : UNPACK_SWAP32;
+        if (rh->unpack_kind == UNPACK_DEINT2_16) {
+            rh->unpack_kind = UNPACK_DEINT2_16BE;
+        } else if (rh->unpack_kind == UNPACK_DEINT3_16) {
+            rh->unpack_kind = UNPACK_DEINT3_16BE;
+        }
+    }
 
     return NULL;
 }
@@ -667,15 +3095,24 @@ static void close_handler(rs_hnd_t *rh)
     if (!rh) {
         return;
     }
-    if (rh->frame_buff) {
-        free(rh->frame_buff);
-    }
-    if (rh->index) {
+    /* every thread which may still read the index or the file is joined
+       before they go away. */
+    stop_prefetcher(rh);
+    rs_workers_destroy(rh->workers);
+    stop_cache(rh);
+    stop_siblings(rh);
+    stop_stream(rh);
+    stop_follow(rh);
+    stop_sequence(rh);
+    if (rh->index_map) {
+        unmap_file(rh->index_map, rh->index_map_size);
+    } else if (rh->index) {
         free(rh->index);
     }
-    if (rh->file) {
-        fclose(rh->file);
-    }
+    close_source_file(rh);
+    pool_destroy(&rh->scratch);
+    pool_destroy(&rh->chunks);
+    pool_destroy(&rh->pool);
     free(rh);
 }
 
@@ -697,56 +3134,159 @@ vs_init(VSMap *in, VSMap *out, void **instance_data, VSNode *node,
 }
 
 
-static const VSFrameRef * VS_CC
-rs_get_frame(int n, int activation_reason, void **instance_data,
-             void **frame_data, VSFrameContext *frame_ctx, VSCore *core,
-             const VSAPI *vsapi)
+static const VSFrameRef *
+get_frame(rs_hnd_t *rh, int n, VSFrameContext *frame_ctx, VSCore *core,
+          const VSAPI *vsapi)
 {
-    if (activation_reason != arInitial) {
-        return NULL;
-    }
-
-    rs_hnd_t *rh = (rs_hnd_t *)*instance_data;
-
     int frame_number = n;
     if (n >= rh->vi[0].numFrames) {
         frame_number = rh->vi[0].numFrames - 1;
     }
 
-    if (rs_fseek(rh->file, rh->index[frame_number], SEEK_SET) != 0 ||
-        fread(rh->frame_buff, 1, rh->frame_size, rh->file) < rh->frame_size) {
-        return NULL;
+    int out = rh->has_alpha ? vsapi->getOutputIndex(frame_ctx) : 0;
+    if (rh->stream) {
+        const char *err = NULL;
+        const VSFrameRef *frame =
+            stream_get_frame(rh, frame_number, out, core, vsapi, &err);
+        if (!frame) {
+            vsapi->setFilterError(err, frame_ctx);
+        }
+        return frame;
+    }
+
+    if (rh->cache) {
+        const VSFrameRef *cached = cache_get(rh->cache, frame_number, out);
+        if (cached) {
+            return cached;
+        }
+    }
+
+    int64_t pos = 0;
+    if (rh->follow) {
+        const char *err = follow_frame(rh, frame_number, &pos);
+        if (err) {
+            vsapi->setFilterError(err, frame_ctx);
+            return NULL;
+        }
+    } else if (rh->index) {
+        pos = index_pos(rh, frame_number);
+        if (pos < 0) {
+            vsapi->setFilterError("raws: the sidecar index does not match "
+                                  "the source, delete it to rebuild it",
+                                  frame_ctx);
+            return NULL;
+        }
+    }
+
+    int sibling = -1;
+    if (rh->siblings) {
+        const VSFrameRef *shared;
+        sibling = sibling_claim(rh->siblings, frame_number, out, &shared);
+        if (shared) {
+            return shared;
+        }
+    }
+
+    uint8_t *buff = NULL;
+    const uint8_t *srcp;
+    pf_slot_t *slot = NULL;
+    int64_t pf_hits = 0, pf_misses = 0;
+
+    if (rh->pf) {
+        slot = prefetch_get(rh->pf, frame_number, &pf_hits, &pf_misses);
+    }
+
+    /* the unpackers may look a few bytes beyond the end of a frame, so the
+       mapping is only used directly when that cannot run off the file. */
+    if (slot) {
+        srcp = slot->srcp;
+    } else if (rh->map && pos + rh->frame_size + FRAME_PADDING <= rh->file_size) {
+        srcp = rh->map + pos;
+    } else if (rh->fused_read) {
+        srcp = NULL;
+    } else {
+        buff = pool_get(&rh->pool);
+        if (!buff) {
+            if (sibling >= 0) {
+                sibling_abort(rh->siblings, sibling);
+            }
+            vsapi->setFilterError("raws: failed to allocate buffer", frame_ctx);
+            return NULL;
+        }
+        const char *err = "raws: failed to read frame";
+        srcp = rh->seq ? seq_read_frame(rh, frame_number, buff, &err)
+                       : read_frame(rh, pos, buff);
+        if (!srcp) {
+            pool_release(&rh->pool, buff);
+            if (sibling >= 0) {
+                sibling_abort(rh->siblings, sibling);
+            }
+            vsapi->setFilterError(err, frame_ctx);
+            return NULL;
+        }
     }
 
     VSFrameRef *dst[2];
-    dst[0] = vsapi->newVideoFrame(rh->vi[0].format, rh->vi[0].width, rh->vi[0].height,
-                                  NULL, core);
+    int decoded = decode_frame(rh, srcp, pos, dst, vsapi, core);
+    pool_release(&rh->pool, buff);
+    if (slot) {
+        prefetch_release(rh->pf, slot);
+    }
+    if (decoded != 0) {
+        if (sibling >= 0) {
+            sibling_abort(rh->siblings, sibling);
+        }
+        vsapi->setFilterError("raws: failed to read frame", frame_ctx);
+        return NULL;
+    }
 
-    VSMap *props = vsapi->getFramePropsRW(dst[0]);
-    vsapi->propSetInt(props, "_DurationNum", rh->vi[0].fpsDen, paReplace);
-    vsapi->propSetInt(props, "_DurationDen", rh->vi[0].fpsNum, paReplace);
-    vsapi->propSetInt(props, "_SARNum", rh->sar_num, paReplace);
-    vsapi->propSetInt(props, "_SARDen", rh->sar_den, paReplace);
+    if (rh->pf) {
+        VSMap *props = vsapi->getFramePropsRW(dst[0]);
+        vsapi->propSetInt(props, "PrefetchHits", pf_hits, paReplace);
+        vsapi->propSetInt(props, "PrefetchMisses", pf_misses, paReplace);
+    }
+    if (rh->seq) {
+        rs_fd_pool_stats_t fs;
+        rs_fd_pool_stats(rh->seq->files, &fs);
+        VSMap *props = vsapi->getFramePropsRW(dst[0]);
+        vsapi->propSetInt(props, "FilePoolCapacity", fs.capacity, paReplace);
+        vsapi->propSetInt(props, "FilePoolOpen", fs.num_open, paReplace);
+        vsapi->propSetInt(props, "FilePoolOpens", fs.opens, paReplace);
+        vsapi->propSetInt(props, "FilePoolEvictions", fs.evictions, paReplace);
+        vsapi->propSetInt(props, "FilePoolHits", fs.hits, paReplace);
+    }
 
-    rh->write_frame(rh, dst, vsapi, core);
+    if (rh->cache) {
+        cache_put(rh->cache, frame_number, dst);
+    }
 
-    if (rh->has_alpha == 0) {
-        return dst[0];
+    if (sibling >= 0) {
+        sibling_publish(rh->siblings, sibling, dst, out);
+    } else if (rh->has_alpha) {
+        vsapi->freeFrame(dst[out ^ 1]);
     }
+    return dst[out];
+}
 
-    if (vsapi->getOutputIndex(frame_ctx) == 0) {
-        vsapi->freeFrame(dst[1]);
-        return dst[0];
+
+static const VSFrameRef * VS_CC
+rs_get_frame(int n, int activation_reason, void **instance_data,
+             void **frame_data, VSFrameContext *frame_ctx, VSCore *core,
+             const VSAPI *vsapi)
+{
+    if (activation_reason != arInitial) {
+        return NULL;
     }
 
-    vsapi->freeFrame(dst[0]);
-    props = vsapi->getFramePropsRW(dst[1]);
-    vsapi->propSetInt(props, "_DurationNum", rh->vi[1].fpsDen, paReplace);
-    vsapi->propSetInt(props, "_DurationDen", rh->vi[1].fpsNum, paReplace);
-    vsapi->propSetInt(props, "_SARNum", rh->sar_num, paReplace);
-    vsapi->propSetInt(props, "_SARDen", rh->sar_den, paReplace);
+    rs_hnd_t *rh = (rs_hnd_t *)*instance_data;
 
-    return dst[1];
+    if (!rh->workers) {
+        return get_frame(rh, n, frame_ctx, core, vsapi);
+    }
+    rs_workers_enter(rh->workers);
+    const VSFrameRef *frame = get_frame(rh, n, frame_ctx, core, vsapi);
+    rs_workers_leave(rh->workers);
+    return frame;
 }
 
 
@@ -801,16 +3341,39 @@ create_source(const VSMap *in, VSMap *out, void *user_data, VSCore *core,
 
     rs_hnd_t *rh = (rs_hnd_t *)calloc(sizeof(rs_hnd_t), 1);
     RET_IF_ERROR(!rh, "couldn't create handler");
+    rh->fd = RS_INVALID_FD;
+    pool_init(&rh->pool);
+    pool_init(&rh->chunks);
+    pool_init(&rh->scratch);
+
+    vs_args_t va = { in, out, core, vsapi };
 
-    const char *err =
-        open_source_file(rh, vsapi->propGetData(in, "source", 0, 0));
+    const char *src_name = vsapi->propGetData(in, "source", 0, 0);
+    if (vsapi->propNumElements(in, "source") > 1 ||
+        (is_seq_pattern(src_name) && !file_exists(src_name, NULL))) {
+        int start_number, max_open;
+        set_args_int(&start_number, -1, "start_number", &va);
+        set_args_int(&max_open, SEQ_MAX_OPEN, "max_open_files", &va);
+        RET_IF_ERROR(max_open < 1, "max_open_files must be 1 or more");
+        const char *sq = start_sequence(rh, in, core, vsapi, start_number,
+                                        max_open);
+        RET_IF_ERROR(sq, "%s", sq);
+        src_name = rh->seq->segments[0].path;
+    }
+
+    const char *err = open_source_file(rh, src_name);
     RET_IF_ERROR(err, "%s", err);
+    RET_IF_ERROR(rh->seq && rh->stream,
+                 "a stream cannot be a part of multiple files");
 
     int header = check_header(rh);
     RET_IF_ERROR(header == -1, "invalid YUV4MPEG2 header was found");
     RET_IF_ERROR(header == -2, "unsupported YUV4MPEG2 header was found");
-
-    vs_args_t va = { in, out, core, vsapi };
+    RET_IF_ERROR(rh->seq && rh->is_y4m,
+                 "YUV4MPEG2 files cannot be read as multiple files");
+    if (rh->seq) {
+        rh->seq->is_bmp = header == 0;
+    }
 
     if (header > 0) {
         set_args_int(&rh->vi[0].width, 720, "width", &va);
@@ -820,7 +3383,7 @@ create_source(const VSMap *in, VSMap *out, void *user_data, VSCore *core,
         set_args_int(&rh->sar_num, 1, "sarnum", &va);
         set_args_int(&rh->sar_den, 1, "sarden", &va);
         set_args_int(&rh->row_adjust, 1, "rowbytes_align", &va);
-        set_args_data(rh->src_format, "I420", "src_fmt", FORMAT_MAX_LEN, &va);
+        set_args_data(rh->src_format, "I420", "src_fmt", FORMAT_MAX_LEN - 1, &va);
     }
 
     if (rh->vi[0].fpsNum == 0 && rh->vi[0].fpsDen == 0) {
@@ -836,23 +3399,309 @@ create_source(const VSMap *in, VSMap *out, void *user_data, VSCore *core,
     const char *ca = check_args(rh, &va);
     RET_IF_ERROR(ca, "%s", ca);
 
-    rh->vi[0].numFrames =
-        (int)((rh->file_size - rh->off_header) / (rh->off_frame + rh->frame_size));
-    RET_IF_ERROR(rh->vi[0].numFrames < 1, "too small file size");
+    /* the crop is applied while the frames are read, vi holds the cropped
+       size and the layouts address the source by its own. */
+    int crop_right, crop_bottom;
+    set_args_int(&rh->crop_left, 0, "crop_left", &va);
+    set_args_int(&crop_right, 0, "crop_right", &va);
+    set_args_int(&rh->crop_top, 0, "crop_top", &va);
+    set_args_int(&crop_bottom, 0, "crop_bottom", &va);
+    RET_IF_ERROR(rh->crop_left < 0 || crop_right < 0 || rh->crop_top < 0 ||
+                 crop_bottom < 0, "crop values must be 0 or more");
+    int mod_w = 1 << rh->vi[0].format->subSamplingW;
+    int mod_h = 1 << rh->vi[0].format->subSamplingH;
+    RET_IF_ERROR((rh->crop_left | crop_right) % mod_w != 0,
+                 "crop_left and crop_right must be multiples of %d", mod_w);
+    RET_IF_ERROR((rh->crop_top | crop_bottom) % mod_h != 0,
+                 "crop_top and crop_bottom must be multiples of %d", mod_h);
+    RET_IF_ERROR(rh->crop_left + crop_right >= rh->vi[0].width ||
+                 rh->crop_top + crop_bottom >= rh->vi[0].height,
+                 "crop leaves an empty frame");
+    rh->src_width = rh->vi[0].width;
+    rh->src_height = rh->vi[0].height;
+    rh->vi[0].width -= rh->crop_left + crop_right;
+    rh->vi[0].height -= rh->crop_top + crop_bottom;
+
+    /* a proxy keeps every proxy-th row and column of what the crop left,
+       rounded down to whole chroma samples. */
+    set_args_int(&rh->proxy, 1, "proxy", &va);
+    RET_IF_ERROR(rh->proxy != 1 && rh->proxy != 2 && rh->proxy != 4 &&
+                 rh->proxy != 8, "proxy must be 1, 2, 4 or 8");
+    rh->vi[0].width = (rh->vi[0].width / rh->proxy) & ~(mod_w - 1);
+    rh->vi[0].height = (rh->vi[0].height / rh->proxy) & ~(mod_h - 1);
+    RET_IF_ERROR(rh->vi[0].width == 0 || rh->vi[0].height == 0,
+                 "proxy leaves an empty frame");
+
+    /* out_depth and out_sample_type convert the samples while they are
+       copied or unpacked. integer depths are shifted, rounding to nearest
+       when they shrink, and float output maps the integer range onto
+       0..1, or -0.5..0.5 for yuv chroma. */
+    rh->src_fi = rh->vi[0].format;
+    const VSFormat *src_fi = rh->src_fi;
+    int out_type, out_depth;
+    set_args_int(&out_type, src_fi->sampleType, "out_sample_type", &va);
+    RET_IF_ERROR(out_type != stInteger && out_type != stFloat,
+                 "out_sample_type must be 0 (integer) or 1 (float)");
+    set_args_int(&out_depth, out_type == src_fi->sampleType ?
+                 src_fi->bitsPerSample : 32, "out_depth", &va);
+    if (out_type != src_fi->sampleType || out_depth != src_fi->bitsPerSample) {
+        RET_IF_ERROR(src_fi->sampleType == stFloat,
+                     "float formats cannot be converted");
+        RET_IF_ERROR(out_type == stInteger && (out_depth < 8 || out_depth > 16),
+                     "out_depth must be between 8 and 16 for integer output");
+        RET_IF_ERROR(out_type == stFloat && out_depth != 16 && out_depth != 32,
+                     "out_depth must be 16 or 32 for float output");
+        int bits = src_fi->bitsPerSample;
+        int wide = src_fi->bytesPerSample == 2;
+        if (out_type == stFloat) {
+            rh->convert_kind = out_depth == 32 ?
+                (wide ? CONVERT_U16_F32 : CONVERT_U8_F32) :
+                (wide ? CONVERT_U16_F16 : CONVERT_U8_F16);
+        } else {
+            rh->convert_kind = out_depth == 8 ? CONVERT_U16_U8 :
+                wide ? CONVERT_U16_U16 : CONVERT_U8_U16;
+            rh->convert.shift = out_depth - bits;
+            rh->convert.max = (1 << out_depth) - 1;
+        }
+        /* the largest sample of p010 and p210 is 1023 << 6, which has to
+           come out as 1.0 too. */
+        int sig = rh->significant_bits ? rh->significant_bits : bits;
+        rh->convert.scale = 1.0f / (((1 << sig) - 1) << (bits - sig));
+        rh->chroma_bias = -(1 << (bits - 1));
+        rh->vi[0].format =
+            vsapi->registerFormat(src_fi->colorFamily, out_type, out_depth,
+                                  src_fi->subSamplingW, src_fi->subSamplingH,
+                                  core);
+        RET_IF_ERROR(!rh->vi[0].format,
+                     "out_depth and out_sample_type give an invalid format");
+    }
+
+    /* planes= restricts the reads to the planes it selects. a lone luma
+       plane comes out as a gray clip, other planes left out are blank. */
+    rh->plane_mask = (1 << rh->src_fi->numPlanes) - 1;
+    int num_selected = vsapi->propNumElements(in, "planes");
+    if (num_selected > 0) {
+        RET_IF_ERROR(rh->layout_frame != layout_planar_frame &&
+                     rh->layout_frame != layout_nvxx_frame &&
+                     rh->layout_frame != layout_px1x_frame,
+                     "planes needs a planar or semi-planar format");
+        rh->plane_mask = 0;
+        for (int i = 0; i < num_selected; i++) {
+            int64_t plane = vsapi->propGetInt(in, "planes", i, NULL);
+            RET_IF_ERROR(plane < 0 || plane >= rh->src_fi->numPlanes,
+                         "planes must be between 0 and %d",
+                         rh->src_fi->numPlanes - 1);
+            rh->plane_mask |= 1 << plane;
+        }
+        RET_IF_ERROR(rh->num_src_planes == 2 && (rh->plane_mask & 6) &&
+                     (rh->plane_mask & 6) != 6,
+                     "the chroma planes of semi-planar formats can only be "
+                     "selected together");
+        if (rh->plane_mask == 1) {
+            rh->vi[0].format =
+                vsapi->registerFormat(cmGray, rh->vi[0].format->sampleType,
+                                      rh->vi[0].format->bitsPerSample, 0, 0,
+                                      core);
+        }
+    }
+
+    char index_path[FILENAME_MAX * 4] = { 0 };
+    char default_path[FILENAME_MAX * 4] = { 0 };
+    if (snprintf(default_path, sizeof default_path, "%s"INDEX_SUFFIX,
+                 src_name) >= (int)sizeof default_path) {
+        default_path[0] = '\0';
+    }
+    set_args_data(index_path, default_path, "index_path",
+                  sizeof index_path - 1, &va);
+    int num_frames, follow;
+    set_args_int(&num_frames, 0, "num_frames", &va);
+    RET_IF_ERROR(num_frames < 0, "num_frames must be 0 or more");
+    set_args_int(&follow, 0, "follow", &va);
+    RET_IF_ERROR(follow && rh->stream, "follow cannot be used with a stream");
+    RET_IF_ERROR(follow && rh->seq, "follow cannot be used with multiple files");
+    if (rh->seq) {
+        /* every read goes to the file of its frame, the probed one is not
+           kept open. */
+        const char *is = index_sequence(rh);
+        RET_IF_ERROR(is, "%s", is);
+        RET_IF_ERROR(rh->vi[0].numFrames < 1, "too small file size");
+        close_source_file(rh);
+        if (num_frames > 0 && num_frames < rh->vi[0].numFrames) {
+            rh->vi[0].numFrames = num_frames;
+        }
+    } else if (rh->stream || follow) {
+        /* the length of a stream or of a growing file is unknown, so it is
+           open-ended unless given. requests beyond its end fail. */
+        rh->vi[0].numFrames = num_frames > 0 ? num_frames : INT_MAX;
+    } else {
+        RET_IF_ERROR(create_index(rh, index_path[0] ? index_path : NULL),
+                     "failed to create index");
+        RET_IF_ERROR(rh->vi[0].numFrames < 1, "too small file size");
+        if (num_frames > 0 && num_frames < rh->vi[0].numFrames) {
+            rh->vi[0].numFrames = num_frames;
+        }
+    }
+    if (follow) {
+        int timeout;
+        set_args_int(&timeout, 10000, "follow_timeout", &va);
+        RET_IF_ERROR(timeout < 0, "follow_timeout must be 0 or more");
+        const char *sf = start_follow(rh, src_name, timeout);
+        RET_IF_ERROR(sf, "%s", sf);
+    }
+
+    char cpu_opt[FORMAT_MAX_LEN] = { 0 };
+    set_args_data(cpu_opt, "auto", "cpu_opt", FORMAT_MAX_LEN - 1, &va);
+    int cpu_level = rs_parse_cpu_opt(cpu_opt);
+    RET_IF_ERROR(cpu_level < 0, "invalid cpu_opt was specified");
+    rh->unpack_row = rs_get_unpack_row(rh->unpack_kind, cpu_level);
+    rh->swap_row = rs_get_unpack_row(rh->swap_kind, cpu_level);
+    rh->convert_row = rs_get_convert_row(rh->convert_kind, cpu_level);
+    if (rh->proxy > 1) {
+        /* the packed layouts decimate whole pixels, and the semi-planar
+           ones pairs of chroma samples. 4:2:2 pairs of pixels are rebuilt
+           from the luma and chroma samples kept. */
+        int bps = rh->src_fi->bytesPerSample;
+        rh->unpack_unit = rh->layout_frame == layout_packed_rgb ? bps * (3 + rh->has_alpha)
+                        : rh->layout_frame == layout_packed_yuv422 ? 4 : 2 * bps;
+        rh->copy_decimate = rs_get_decimate_row(bps, cpu_level);
+        if (rh->layout_frame == layout_packed_yuv422) {
+            rh->unpack_decimate = rs_get_decimate_422(rh->order[0] == 0 ? 0 : 1);
+        } else {
+            rh->unpack_decimate = rs_get_decimate_row(rh->unpack_unit, cpu_level);
+        }
+    }
+    if (rh->proxy > 1 || rh->convert_row) {
+        /* one decimated row, and up to four unpacked ones to convert, none
+           of them longer than a source row. */
+        rh->tmp_stride = (rh->frame_size / rh->src_height + FRAME_PADDING + 63) & ~63;
+        rh->scratch.size = rh->tmp_stride * (rh->convert_row ? 5 : 1);
+    }
+
+    /* streaming stores only pay off once a frame is about the size of the
+       last level cache and would not stay there anyway; nt_store forces
+       either path for benchmarking. */
+    int nt_store;
+    set_args_int(&nt_store, -1, "nt_store", &va);
+    RET_IF_ERROR(nt_store < -1 || nt_store > 1, "nt_store must be -1, 0 or 1");
+    if (nt_store == 1 || (nt_store == -1 && rh->frame_size >= STREAM_MIN_SIZE)) {
+        rh->stream_copy = rs_get_stream_copy(cpu_level);
+    }
+
+    int use_mmap;
+    set_args_int(&use_mmap, 0, "mmap", &va);
+    set_args_int(&rh->direct_io, 0, "direct_io", &va);
+    RET_IF_ERROR(use_mmap && rh->direct_io,
+                 "mmap and direct_io cannot be used together");
+    RET_IF_ERROR(rh->stream && (use_mmap || rh->direct_io),
+                 "mmap and direct_io cannot be used with a stream");
+    RET_IF_ERROR(rh->follow && use_mmap, "mmap cannot be used with follow");
+    RET_IF_ERROR(rh->seq && (use_mmap || rh->direct_io),
+                 "mmap and direct_io cannot be used with multiple files");
+    if (use_mmap) {
+        char advice[FORMAT_MAX_LEN] = { 0 };
+        set_args_data(advice, "normal", "mmap_advice", FORMAT_MAX_LEN - 1, &va);
+        const char *ms = map_source_file(rh, advice);
+        RET_IF_ERROR(ms, "%s", ms);
+    }
+
+    if (rh->direct_io) {
+        /* the probes above need unaligned reads, so the file is reopened
+           for direct I/O only now. */
+        close_source_file(rh);
+        rh->fd = rs_open(src_name, 1);
+        RET_IF_ERROR(rh->fd == RS_INVALID_FD,
+                     "failed to open source file for direct I/O");
+        rh->pool.alignment = DIRECT_IO_ALIGNMENT;
+        rh->pool.size = rh->frame_size + DIRECT_IO_ALIGNMENT * 2;
+    } else {
+        rh->pool.size = rh->frame_size + FRAME_PADDING;
+    }
 
-    RET_IF_ERROR(create_index(rh), "failed to create index");
+    int use_uring, prefetch;
+    set_args_int(&use_uring, 0, "io_uring", &va);
+    set_args_int(&prefetch, use_uring ? 8 : 0, "prefetch", &va);
+    RET_IF_ERROR(prefetch < 0, "prefetch must be 0 or more");
+    RET_IF_ERROR(prefetch > 0 && use_mmap,
+                 "prefetch cannot be used together with mmap");
+    RET_IF_ERROR(prefetch > 0 && rh->stream,
+                 "prefetch cannot be used with a stream");
+    RET_IF_ERROR(prefetch > 0 && rh->follow,
+                 "prefetch cannot be used with follow");
+    RET_IF_ERROR(prefetch > 0 && rh->seq,
+                 "prefetch cannot be used with multiple files");
+    if (prefetch > 0) {
+        const char *sp = start_prefetcher(rh, prefetch, use_uring);
+        RET_IF_ERROR(sp, "%s", sp);
+    }
 
-    rh->frame_buff = (uint8_t *)malloc(rh->frame_size + 32);
-    RET_IF_ERROR(!rh->frame_buff, "failed to allocate buffer");
+    /* a frame read in one piece has left the cache by the time it is
+       unpacked, so large ones are read band by band instead. below a few
+       MiB the extra reads cost more than the cache misses they save.
+       planes which are only copied are read straight into the frame,
+       which pays off at any size, as does skipping the rows a proxy
+       leaves out. */
+    int fused_read;
+    set_args_int(&fused_read, 1, "fused_read", &va);
+    int scatter = !rh->swap_row && !rh->convert_row &&
+                  (rh->layout_frame == layout_planar_frame ||
+                   !(rh->plane_mask & 6));
+    rh->fused_read = fused_read && !use_mmap && !rh->direct_io && !rh->pf &&
+                     !rh->stream && !rh->seq &&
+                     (scatter || rh->proxy > 1 ||
+                      rh->frame_size >= FUSED_MIN_SIZE);
+    if (rh->fused_read) {
+        /* a band holds one row at least, and no row is longer than
+           frame_size / height. */
+        rh->chunks.size = BAND_SIZE + rh->frame_size / rh->src_height + FRAME_PADDING;
+    }
 
     if (rh->has_alpha) {
         rh->vi[1] = rh->vi[0];
-        VSPresetFormat pf =
-            rh->vi[0].format->bytesPerSample == 1 ? pfGray8 : pfGray16;
-        rh->vi[1].format = vsapi->getFormatPreset(pf, core);
+        rh->vi[1].format =
+            vsapi->registerFormat(cmGray, rh->vi[0].format->sampleType,
+                                  rh->vi[0].format->bitsPerSample, 0, 0, core);
+    }
+
+    int num_threads = vsapi->getCoreInfo(core)->numThreads;
+    int threads;
+    set_args_int(&threads, 1, "threads", &va);
+    RET_IF_ERROR(threads < 0, "threads must be 0 or more");
+    if (threads == 0) {
+        threads = num_threads;
+    }
+    if (threads > 1) {
+        /* the core's threads are not outgrown by default, more than that
+           only when asked for. */
+        rh->workers = rs_workers_create(threads, threads > num_threads ?
+                                                 threads : num_threads);
+        RET_IF_ERROR(!rh->workers, "failed to start worker threads");
+    }
+
+    if (rh->stream) {
+        int window;
+        set_args_int(&window, num_threads > 4 ? num_threads * 2 : 8,
+                     "stream_window", &va);
+        RET_IF_ERROR(window < 1, "stream_window must be 1 or more");
+        const char *ss = start_stream(rh, window, vsapi);
+        RET_IF_ERROR(ss, "%s", ss);
+    } else if (rh->has_alpha) {
+        const char *ss = start_siblings(rh, num_threads > 2 ? num_threads * 2 : 4, vsapi);
+        RET_IF_ERROR(ss, "%s", ss);
+    }
+
+    int cache_mb;
+    set_args_int(&cache_mb, 0, "cache_mb", &va);
+    RET_IF_ERROR(cache_mb < 0, "cache_mb must be 0 or more");
+    RET_IF_ERROR(cache_mb > 0 && rh->stream,
+                 "cache_mb cannot be used with a stream");
+    RET_IF_ERROR(cache_mb > 0 && rh->follow,
+                 "cache_mb cannot be used with follow");
+    if (cache_mb > 0) {
+        const char *sc = start_cache(rh, cache_mb, vsapi);
+        RET_IF_ERROR(sc, "%s", sc);
     }
     vsapi->createFilter(in, out, "Source", vs_init, rs_get_frame, vs_close,
-                        fmSerial, 0, rh, core);
+                        fmParallel, 0, rh, core);
 }
 #undef RET_IF_ERROR
 
@@ -860,11 +3709,21 @@ create_source(const VSMap *in, VSMap *out, void *user_data, VSCore *core,
 VS_EXTERNAL_API(void) VapourSynthPluginInit(
     VSConfigPlugin f_config, VSRegisterFunction f_register, VSPlugin *plugin)
 {
+    rs_unpack_init();
     f_config("chikuzen.does.not.have.his.own.domain.raws", "raws",
              "Raw-format file Reader for VapourSynth " VS_RAWS_VERSION,
              VAPOURSYNTH_API_VERSION, 1, plugin);
-    f_register("Source", "source:data;width:int:opt;height:int:opt;"
+    f_register("Source", "source:data[];width:int:opt;height:int:opt;"
                "fpsnum:int:opt;fpsden:int:opt;sarnum:int:opt;sarden:int:opt;"
                "src_fmt:data:opt;off_header:int:opt;off_frame:int:opt;"
-               "rowbytes_align:int:opt", create_source, NULL, plugin);
+               "rowbytes_align:int:opt;mmap:int:opt;mmap_advice:data:opt;"
+               "direct_io:int:opt;prefetch:int:opt;io_uring:int:opt;"
+               "cpu_opt:data:opt;cache_mb:int:opt;index_path:data:opt;"
+               "num_frames:int:opt;stream_window:int:opt;follow:int:opt;"
+               "follow_timeout:int:opt;start_number:int:opt;"
+               "max_open_files:int:opt;threads:int:opt;fused_read:int:opt;"
+               "nt_store:int:opt;crop_left:int:opt;crop_right:int:opt;"
+               "crop_top:int:opt;crop_bottom:int:opt;planes:int[]:opt;"
+               "proxy:int:opt;out_depth:int:opt;out_sample_type:int:opt",
+               create_source, NULL, plugin);
 }
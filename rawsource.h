@@ -28,32 +28,70 @@
 
 #define VS_RAWS_VERSION "0.3.1"
 
+#ifndef _WIN32
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+#endif
+
 #ifdef _WIN32
-#ifdef __MINGW32__
-#define rs_fseek fseeko64
-#define rs_ftell ftello64
-#else
+#ifndef __MINGW32__
 #pragma warning(disable:4996)
-#define rs_fseek _fseeki64
-#define rs_ftell _ftelli64
 #define snprintf _snprintf
 #define strcasecmp stricmp
 #endif
 #include <windows.h>
+#include <malloc.h>
+typedef HANDLE rs_fd_t;
+#define RS_INVALID_FD INVALID_HANDLE_VALUE
+typedef CRITICAL_SECTION rs_mutex_t;
+#define rs_mutex_init(m)    InitializeCriticalSection(m)
+#define rs_mutex_destroy(m) DeleteCriticalSection(m)
+#define rs_mutex_lock(m)    EnterCriticalSection(m)
+#define rs_mutex_unlock(m)  LeaveCriticalSection(m)
+typedef CONDITION_VARIABLE rs_cond_t;
+#define rs_cond_init(c)      InitializeConditionVariable(c)
+#define rs_cond_destroy(c)
+#define rs_cond_wait(c, m)   SleepConditionVariableCS(c, m, INFINITE)
+#define rs_cond_broadcast(c) WakeAllConditionVariable(c)
+typedef HANDLE rs_thread_t;
+#define RS_THREAD_FUNC DWORD WINAPI
+#define rs_aligned_free(p)  _aligned_free(p)
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <limits.h>
+#ifdef HAVE_INOTIFY
+#include <sys/inotify.h>
+#include <poll.h>
 #endif
-
-#include <stdio.h>
-
-#ifndef rs_fseek
-#define _FILE_OFFSET_BITS 64
-#define rs_fseek fseek
-#define rs_ftell ftell
+typedef int rs_fd_t;
+#define RS_INVALID_FD (-1)
+typedef pthread_mutex_t rs_mutex_t;
+#define rs_mutex_init(m)    pthread_mutex_init(m, NULL)
+#define rs_mutex_destroy(m) pthread_mutex_destroy(m)
+#define rs_mutex_lock(m)    pthread_mutex_lock(m)
+#define rs_mutex_unlock(m)  pthread_mutex_unlock(m)
+typedef pthread_cond_t rs_cond_t;
+#define rs_cond_init(c)      pthread_cond_init(c, NULL)
+#define rs_cond_destroy(c)   pthread_cond_destroy(c)
+#define rs_cond_wait(c, m)   pthread_cond_wait(c, m)
+#define rs_cond_broadcast(c) pthread_cond_broadcast(c)
+typedef pthread_t rs_thread_t;
+#define RS_THREAD_FUNC void *
+#define rs_aligned_free(p)  free(p)
 #endif
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <string.h>
 #include <stdarg.h>
+#include <limits.h>
+#include <time.h>
 
 #ifdef __GNUC__
 #include <inttypes.h>
@@ -62,6 +100,69 @@
 #define SCNi64 "lld"
 #endif
 
+static inline void *rs_aligned_malloc(size_t size, size_t alignment)
+{
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    void *p;
+    return posix_memalign(&p, alignment, size) ? NULL : p;
+#endif
+}
+
+static inline int rs_thread_create(rs_thread_t *th,
+                                   RS_THREAD_FUNC (*func)(void *), void *arg)
+{
+#ifdef _WIN32
+    *th = CreateThread(NULL, 0, func, arg, 0, NULL);
+    return *th ? 0 : -1;
+#else
+    return pthread_create(th, NULL, func, arg);
+#endif
+}
+
+static inline void rs_thread_join(rs_thread_t th)
+{
+#ifdef _WIN32
+    WaitForSingleObject(th, INFINITE);
+    CloseHandle(th);
+#else
+    pthread_join(th, NULL);
+#endif
+}
+
+static inline rs_fd_t rs_open(const char *src_name, int direct_io)
+{
+#ifdef _WIN32
+    wchar_t tmp[FILENAME_MAX * 4];
+    MultiByteToWideChar(CP_UTF8, 0, src_name, -1, tmp, FILENAME_MAX * 4);
+    DWORD flags = direct_io ? FILE_FLAG_NO_BUFFERING : FILE_ATTRIBUTE_NORMAL;
+    return CreateFileW(tmp, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                       NULL, OPEN_EXISTING, flags, NULL);
+#else
+    int flags = O_RDONLY;
+#ifdef O_DIRECT
+    if (direct_io) {
+        flags |= O_DIRECT;
+    }
+#else
+    if (direct_io) {
+        return RS_INVALID_FD;
+    }
+#endif
+    return open(src_name, flags);
+#endif
+}
+
+static inline void rs_close(rs_fd_t fd)
+{
+#ifdef _WIN32
+    CloseHandle(fd);
+#else
+    close(fd);
+#endif
+}
+
 typedef struct {
     uint32_t header_size;
     int32_t width;
@@ -0,0 +1,1845 @@
+/*
+  unpack.c: row kernels for the packed source formats of vsrawsource
+
+  This file is a part of vsrawsource
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with Libav; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "rawsource.h"
+#include "unpack.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define RS_ARCH_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#ifdef __GNUC__
+#define RS_TARGET(x) __attribute__((target(x)))
+#else
+#define RS_TARGET(x)
+#endif
+
+
+static inline uint32_t
+bitor8to32(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3)
+{
+    return ((uint32_t)b0 << 24) | ((uint32_t)b1 << 16) |
+           ((uint32_t)b2 << 8) | (uint32_t)b3;
+}
+
+
+static inline uint16_t bswap16(uint16_t v)
+{
+    return (uint16_t)(v << 8 | v >> 8);
+}
+
+
+/* scalar reference kernels. the simd versions below fall back to these
+   for whatever is left of a row after their last full block, so every
+   kernel writes exactly width pixels. */
+
+static void
+unpack_deint2_8_c(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    uint32_t *dstp0 = (uint32_t *)dstp[0];
+    uint32_t *dstp1 = (uint32_t *)dstp[1];
+
+    for (int x = 0, n = width >> 2; x < n; x++, srcp += 8) {
+        dstp0[x] = bitor8to32(srcp[6], srcp[4], srcp[2], srcp[0]);
+        dstp1[x] = bitor8to32(srcp[7], srcp[5], srcp[3], srcp[1]);
+    }
+    for (int x = width & ~3; x < width; x++, srcp += 2) {
+        dstp[0][x] = srcp[0];
+        dstp[1][x] = srcp[1];
+    }
+}
+
+
+static void
+unpack_deint2_16_c(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    const uint16_t *srcp16 = (const uint16_t *)srcp;
+    uint16_t *dstp0 = (uint16_t *)dstp[0];
+    uint16_t *dstp1 = (uint16_t *)dstp[1];
+
+    for (int x = 0; x < width; x++) {
+        dstp0[x] = srcp16[2 * x];
+        dstp1[x] = srcp16[2 * x + 1];
+    }
+}
+
+
+static void
+unpack_deint2_16be_c(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    const uint16_t *srcp16 = (const uint16_t *)srcp;
+    uint16_t *dstp0 = (uint16_t *)dstp[0];
+    uint16_t *dstp1 = (uint16_t *)dstp[1];
+
+    for (int x = 0; x < width; x++) {
+        dstp0[x] = bswap16(srcp16[2 * x]);
+        dstp1[x] = bswap16(srcp16[2 * x + 1]);
+    }
+}
+
+
+static void
+unpack_deint3_8_c(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    uint32_t *dstp0 = (uint32_t *)dstp[0];
+    uint32_t *dstp1 = (uint32_t *)dstp[1];
+    uint32_t *dstp2 = (uint32_t *)dstp[2];
+
+    for (int x = 0, n = width >> 2; x < n; x++, srcp += 12) {
+        dstp0[x] = bitor8to32(srcp[9], srcp[6], srcp[3], srcp[0]);
+        dstp1[x] = bitor8to32(srcp[10], srcp[7], srcp[4], srcp[1]);
+        dstp2[x] = bitor8to32(srcp[11], srcp[8], srcp[5], srcp[2]);
+    }
+    for (int x = width & ~3; x < width; x++, srcp += 3) {
+        dstp[0][x] = srcp[0];
+        dstp[1][x] = srcp[1];
+        dstp[2][x] = srcp[2];
+    }
+}
+
+
+static void
+unpack_deint3_16_c(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    const uint16_t *srcp16 = (const uint16_t *)srcp;
+    uint16_t *dstp0 = (uint16_t *)dstp[0];
+    uint16_t *dstp1 = (uint16_t *)dstp[1];
+    uint16_t *dstp2 = (uint16_t *)dstp[2];
+
+    for (int x = 0; x < width; x++, srcp16 += 3) {
+        dstp0[x] = srcp16[0];
+        dstp1[x] = srcp16[1];
+        dstp2[x] = srcp16[2];
+    }
+}
+
+
+static void
+unpack_deint3_16be_c(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    const uint16_t *srcp16 = (const uint16_t *)srcp;
+    uint16_t *dstp0 = (uint16_t *)dstp[0];
+    uint16_t *dstp1 = (uint16_t *)dstp[1];
+    uint16_t *dstp2 = (uint16_t *)dstp[2];
+
+    for (int x = 0; x < width; x++, srcp16 += 3) {
+        dstp0[x] = bswap16(srcp16[0]);
+        dstp1[x] = bswap16(srcp16[1]);
+        dstp2[x] = bswap16(srcp16[2]);
+    }
+}
+
+
+static void
+unpack_deint4_8_c(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    uint32_t *dstp0 = (uint32_t *)dstp[0];
+    uint32_t *dstp1 = (uint32_t *)dstp[1];
+    uint32_t *dstp2 = (uint32_t *)dstp[2];
+    uint32_t *dstp3 = (uint32_t *)dstp[3];
+
+    for (int x = 0, n = width >> 2; x < n; x++, srcp += 16) {
+        dstp0[x] = bitor8to32(srcp[12], srcp[8], srcp[4], srcp[0]);
+        dstp1[x] = bitor8to32(srcp[13], srcp[9], srcp[5], srcp[1]);
+        dstp2[x] = bitor8to32(srcp[14], srcp[10], srcp[6], srcp[2]);
+        dstp3[x] = bitor8to32(srcp[15], srcp[11], srcp[7], srcp[3]);
+    }
+    for (int x = width & ~3; x < width; x++, srcp += 4) {
+        for (int i = 0; i < 4; i++) {
+            dstp[i][x] = srcp[i];
+        }
+    }
+}
+
+
+static void
+unpack_swap16_c(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    const uint16_t *srcp16 = (const uint16_t *)srcp;
+    uint16_t *dstp0 = (uint16_t *)dstp[0];
+
+    for (int x = 0; x < width; x++) {
+        dstp0[x] = bswap16(srcp16[x]);
+    }
+}
+
+
+static void
+unpack_swap32_c(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    uint32_t *dstp0 = (uint32_t *)dstp[0];
+
+    for (int x = 0; x < width; x++, srcp += 4) {
+        dstp0[x] = bitor8to32(srcp[0], srcp[1], srcp[2], srcp[3]);
+    }
+}
+
+
+static void
+unpack_yuyv_c(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    for (int x = 0, n = width >> 1; x < n; x++, srcp += 4) {
+        dstp[0][2 * x] = srcp[0];
+        dstp[1][x] = srcp[1];
+        dstp[0][2 * x + 1] = srcp[2];
+        dstp[2][x] = srcp[3];
+    }
+}
+
+
+static void
+unpack_uyvy_c(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    for (int x = 0, n = width >> 1; x < n; x++, srcp += 4) {
+        dstp[1][x] = srcp[0];
+        dstp[0][2 * x] = srcp[1];
+        dstp[2][x] = srcp[2];
+        dstp[0][2 * x + 1] = srcp[3];
+    }
+}
+
+
+/* a fixed unit size lets the compiler turn each memcpy into one move. */
+#define DEFINE_DECIMATE_C(unit)                                               \
+static void                                                                   \
+decimate_##unit##_c(const uint8_t *srcp, uint8_t *dstp, int num_units,        \
+                    int factor)                                               \
+{                                                                             \
+    for (int x = 0; x < num_units; x++) {                                     \
+        memcpy(dstp + unit * x, srcp + (size_t)unit * factor * x, unit);      \
+    }                                                                         \
+}
+
+DEFINE_DECIMATE_C(1)
+DEFINE_DECIMATE_C(2)
+DEFINE_DECIMATE_C(3)
+DEFINE_DECIMATE_C(4)
+DEFINE_DECIMATE_C(6)
+DEFINE_DECIMATE_C(8)
+
+#undef DEFINE_DECIMATE_C
+
+
+/* the luma of an output pair of 4:2:2 pixels comes from two source pairs
+   factor / 2 apart, its chroma from the first one. */
+#define DEFINE_DECIMATE_422_C(name, luma)                                     \
+static void                                                                   \
+name(const uint8_t *srcp, uint8_t *dstp, int num_units, int factor)           \
+{                                                                             \
+    for (int x = 0; x < num_units; x++) {                                     \
+        const uint8_t *s = srcp + (size_t)4 * factor * x;                     \
+        memcpy(dstp + 4 * x, s, 4);                                           \
+        dstp[4 * x + luma + 2] = s[2 * factor + luma];                        \
+    }                                                                         \
+}
+
+DEFINE_DECIMATE_422_C(decimate_yuyv_c, 0)
+DEFINE_DECIMATE_422_C(decimate_uyvy_c, 1)
+
+#undef DEFINE_DECIMATE_422_C
+
+
+/* a right shift rounds to nearest, saturating the sum at 16 bits first,
+   and a left shift wraps at 16 bits, as the simd versions do. */
+static inline int convert_int(int v, const rs_convert_t *cv)
+{
+    if (cv->shift < 0) {
+        v += 1 << (-cv->shift - 1);
+        v = (v > 0xffff ? 0xffff : v) >> -cv->shift;
+    } else {
+        v = (v << cv->shift) & 0xffff;
+    }
+    return v > cv->max ? cv->max : v;
+}
+
+
+/* rounds to nearest even like vcvtps2ph, subnormals included. the
+   samples never reach the range of infinities. */
+static inline uint16_t float_to_half(float f)
+{
+    union { float f; uint32_t u; } in = { f };
+    uint32_t sign = (in.u >> 16) & 0x8000;
+    int exp = (int)((in.u >> 23) & 0xff) - 127 + 15;
+    uint32_t mant = in.u & 0x7fffff;
+    uint32_t half, rest, halfway;
+
+    if (exp <= 0) {
+        if (exp < -10) {
+            return (uint16_t)sign;
+        }
+        mant |= 0x800000;
+        int shift = 14 - exp;
+        half = mant >> shift;
+        rest = mant & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    } else {
+        half = (uint32_t)exp << 10 | mant >> 13;
+        rest = mant & 0x1fff;
+        halfway = 0x1000;
+    }
+    if (rest > halfway || (rest == halfway && (half & 1))) {
+        half++;
+    }
+    return (uint16_t)(sign | half);
+}
+
+
+static void
+convert_u8_u16_c(const uint8_t *srcp, uint8_t *dstp, int width,
+                 const rs_convert_t *cv)
+{
+    uint16_t *d = (uint16_t *)dstp;
+    for (int x = 0; x < width; x++) {
+        d[x] = (uint16_t)(srcp[x] << cv->shift);
+    }
+}
+
+
+static void
+convert_u16_u8_c(const uint8_t *srcp, uint8_t *dstp, int width,
+                 const rs_convert_t *cv)
+{
+    const uint16_t *s = (const uint16_t *)srcp;
+    for (int x = 0; x < width; x++) {
+        dstp[x] = (uint8_t)convert_int(s[x], cv);
+    }
+}
+
+
+static void
+convert_u16_u16_c(const uint8_t *srcp, uint8_t *dstp, int width,
+                  const rs_convert_t *cv)
+{
+    const uint16_t *s = (const uint16_t *)srcp;
+    uint16_t *d = (uint16_t *)dstp;
+    for (int x = 0; x < width; x++) {
+        d[x] = (uint16_t)convert_int(s[x], cv);
+    }
+}
+
+
+#define DEFINE_CONVERT_FLOAT_C(name, src_type, dst_type, store)              \
+static void                                                                   \
+name(const uint8_t *srcp, uint8_t *dstp, int width, const rs_convert_t *cv)  \
+{                                                                             \
+    const src_type *s = (const src_type *)srcp;                               \
+    dst_type *d = (dst_type *)dstp;                                           \
+    for (int x = 0; x < width; x++) {                                         \
+        d[x] = store((float)(s[x] + cv->bias) * cv->scale);                   \
+    }                                                                         \
+}
+
+#define STORE_F32(f) (f)
+
+DEFINE_CONVERT_FLOAT_C(convert_u8_f32_c, uint8_t, float, STORE_F32)
+DEFINE_CONVERT_FLOAT_C(convert_u16_f32_c, uint16_t, float, STORE_F32)
+DEFINE_CONVERT_FLOAT_C(convert_u8_f16_c, uint8_t, uint16_t, float_to_half)
+DEFINE_CONVERT_FLOAT_C(convert_u16_f16_c, uint16_t, uint16_t, float_to_half)
+
+#undef STORE_F32
+#undef DEFINE_CONVERT_FLOAT_C
+
+
+#ifdef RS_ARCH_X86
+
+/* pshufb masks gathering component k of a 48 byte block of 3 component
+   pixels from each of its three 16 byte parts. */
+static const int8_t deint3_8_shuf[3][3][16] = {
+    {{  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+     { -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14, -1, -1, -1, -1, -1 },
+     { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  1,  4,  7, 10, 13 }},
+    {{  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+     { -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1 },
+     { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14 }},
+    {{  2,  5,  8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+     { -1, -1, -1, -1, -1,  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1 },
+     { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15 }}
+};
+
+static const int8_t deint3_16_shuf[3][3][16] = {
+    {{  0,  1,  6,  7, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+     { -1, -1, -1, -1, -1, -1,  2,  3,  8,  9, 14, 15, -1, -1, -1, -1 },
+     { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  4,  5, 10, 11 }},
+    {{  2,  3,  8,  9, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+     { -1, -1, -1, -1, -1, -1,  4,  5, 10, 11, -1, -1, -1, -1, -1, -1 },
+     { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  0,  1,  6,  7, 12, 13 }},
+    {{  4,  5, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+     { -1, -1, -1, -1,  0,  1,  6,  7, 12, 13, -1, -1, -1, -1, -1, -1 },
+     { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  2,  3,  8,  9, 14, 15 }}
+};
+
+/* the same with the two bytes of each sample swapped, for big-endian
+   sources. */
+static const int8_t deint3_16be_shuf[3][3][16] = {
+    {{  1,  0,  7,  6, 13, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+     { -1, -1, -1, -1, -1, -1,  3,  2,  9,  8, 15, 14, -1, -1, -1, -1 },
+     { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  5,  4, 11, 10 }},
+    {{  3,  2,  9,  8, 15, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+     { -1, -1, -1, -1, -1, -1,  5,  4, 11, 10, -1, -1, -1, -1, -1, -1 },
+     { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  1,  0,  7,  6, 13, 12 }},
+    {{  5,  4, 11, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+     { -1, -1, -1, -1,  1,  0,  7,  6, 13, 12, -1, -1, -1, -1, -1, -1 },
+     { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  3,  2,  9,  8, 15, 14 }}
+};
+
+/* swaps the bytes of the 16 bit samples, sorting the even ones into the
+   low half and the odd ones into the high half. */
+static const int8_t deint2_16be_shuf[16] = {
+    1, 0, 5, 4, 9, 8, 13, 12, 3, 2, 7, 6, 11, 10, 15, 14
+};
+
+static const int8_t swap16_shuf[16] = {
+    1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14
+};
+
+static const int8_t swap32_shuf[16] = {
+    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+};
+
+static const int8_t deint4_8_shuf[16] = {
+    0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15
+};
+
+/* pshufb masks moving the units kept from 16 source bytes to the low
+   16 / factor bytes, by unit size 1, 2, 4 and factor 2, 4, 8. */
+static const int8_t decimate_shuf[3][3][16] = {
+    {{  0,  2,  4,  6,  8, 10, 12, 14, -1, -1, -1, -1, -1, -1, -1, -1 },
+     {  0,  4,  8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+     {  0,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 }},
+    {{  0,  1,  4,  5,  8,  9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1 },
+     {  0,  1,  8,  9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+     {  0,  1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 }},
+    {{  0,  1,  2,  3,  8,  9, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1 },
+     {  0,  1,  2,  3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+     { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 }}
+};
+
+#define LOADU(p) _mm_loadu_si128((const __m128i *)(p))
+#define STOREU(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define LOADU256(p) _mm256_loadu_si256((const __m256i *)(p))
+#define STOREU256(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define LOADU512(p) _mm512_loadu_si512((const void *)(p))
+#define STOREU512(p, v) _mm512_storeu_si512((void *)(p), v)
+
+
+static void RS_TARGET("sse2")
+unpack_deint2_8_sse2(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = LOADU(srcp + 2 * x);
+        __m128i b = LOADU(srcp + 2 * x + 16);
+        STOREU(dstp[0] + x, _mm_packus_epi16(_mm_and_si128(a, mask),
+                                             _mm_and_si128(b, mask)));
+        STOREU(dstp[1] + x, _mm_packus_epi16(_mm_srli_epi16(a, 8),
+                                             _mm_srli_epi16(b, 8)));
+    }
+    if (x < width) {
+        uint8_t *rest[2] = { dstp[0] + x, dstp[1] + x };
+        unpack_deint2_8_c(srcp + 2 * x, rest, width - x);
+    }
+}
+
+
+static void RS_TARGET("sse2")
+unpack_deint2_16_sse2(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    int x = 0;
+
+    for (; x + 8 <= width; x += 8) {
+        __m128i a = LOADU(srcp + 4 * x);
+        __m128i b = LOADU(srcp + 4 * x + 16);
+        __m128i lo_a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+        __m128i lo_b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+        STOREU(dstp[0] + 2 * x, _mm_packs_epi32(lo_a, lo_b));
+        STOREU(dstp[1] + 2 * x, _mm_packs_epi32(_mm_srai_epi32(a, 16),
+                                                _mm_srai_epi32(b, 16)));
+    }
+    if (x < width) {
+        uint8_t *rest[2] = { dstp[0] + 2 * x, dstp[1] + 2 * x };
+        unpack_deint2_16_c(srcp + 4 * x, rest, width - x);
+    }
+}
+
+
+/* luma sits in the even bytes for yuyv and in the odd ones for uyvy. */
+static inline void RS_TARGET("sse2")
+unpack_422_sse2(const uint8_t *srcp, uint8_t **dstp, int width, int uyvy)
+{
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32) {
+        const uint8_t *s = srcp + 2 * x;
+        __m128i a = LOADU(s);
+        __m128i b = LOADU(s + 16);
+        __m128i c = LOADU(s + 32);
+        __m128i d = LOADU(s + 48);
+        __m128i even0 = _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+        __m128i even1 = _mm_packus_epi16(_mm_and_si128(c, mask), _mm_and_si128(d, mask));
+        __m128i odd0 = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        __m128i odd1 = _mm_packus_epi16(_mm_srli_epi16(c, 8), _mm_srli_epi16(d, 8));
+        __m128i luma0 = uyvy ? odd0 : even0;
+        __m128i luma1 = uyvy ? odd1 : even1;
+        __m128i chroma0 = uyvy ? even0 : odd0;
+        __m128i chroma1 = uyvy ? even1 : odd1;
+        STOREU(dstp[0] + x, luma0);
+        STOREU(dstp[0] + x + 16, luma1);
+        STOREU(dstp[1] + x / 2, _mm_packus_epi16(_mm_and_si128(chroma0, mask),
+                                                 _mm_and_si128(chroma1, mask)));
+        STOREU(dstp[2] + x / 2, _mm_packus_epi16(_mm_srli_epi16(chroma0, 8),
+                                                 _mm_srli_epi16(chroma1, 8)));
+    }
+    if (x < width) {
+        uint8_t *rest[3] = { dstp[0] + x, dstp[1] + x / 2, dstp[2] + x / 2 };
+        if (uyvy) {
+            unpack_uyvy_c(srcp + 2 * x, rest, width - x);
+        } else {
+            unpack_yuyv_c(srcp + 2 * x, rest, width - x);
+        }
+    }
+}
+
+
+static void RS_TARGET("sse2")
+unpack_yuyv_sse2(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    unpack_422_sse2(srcp, dstp, width, 0);
+}
+
+
+static void RS_TARGET("sse2")
+unpack_uyvy_sse2(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    unpack_422_sse2(srcp, dstp, width, 1);
+}
+
+
+static inline __m128i RS_TARGET("ssse3")
+gather3_ssse3(__m128i a, __m128i b, __m128i c, const int8_t (*shuf)[16])
+{
+    return _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, LOADU(shuf[0])),
+                                     _mm_shuffle_epi8(b, LOADU(shuf[1]))),
+                        _mm_shuffle_epi8(c, LOADU(shuf[2])));
+}
+
+
+static void RS_TARGET("ssse3")
+unpack_deint3_8_ssse3(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        const uint8_t *s = srcp + 3 * x;
+        __m128i a = LOADU(s);
+        __m128i b = LOADU(s + 16);
+        __m128i c = LOADU(s + 32);
+        for (int k = 0; k < 3; k++) {
+            STOREU(dstp[k] + x, gather3_ssse3(a, b, c, deint3_8_shuf[k]));
+        }
+    }
+    if (x < width) {
+        uint8_t *rest[3] = { dstp[0] + x, dstp[1] + x, dstp[2] + x };
+        unpack_deint3_8_c(srcp + 3 * x, rest, width - x);
+    }
+}
+
+
+static inline void RS_TARGET("ssse3")
+deint3_16_ssse3(const uint8_t *srcp, uint8_t **dstp, int width, int be)
+{
+    const int8_t (*shuf)[3][16] = be ? deint3_16be_shuf : deint3_16_shuf;
+    int x = 0;
+
+    for (; x + 8 <= width; x += 8) {
+        const uint8_t *s = srcp + 6 * x;
+        __m128i a = LOADU(s);
+        __m128i b = LOADU(s + 16);
+        __m128i c = LOADU(s + 32);
+        for (int k = 0; k < 3; k++) {
+            STOREU(dstp[k] + 2 * x, gather3_ssse3(a, b, c, shuf[k]));
+        }
+    }
+    if (x < width) {
+        uint8_t *rest[3] = { dstp[0] + 2 * x, dstp[1] + 2 * x, dstp[2] + 2 * x };
+        if (be) {
+            unpack_deint3_16be_c(srcp + 6 * x, rest, width - x);
+        } else {
+            unpack_deint3_16_c(srcp + 6 * x, rest, width - x);
+        }
+    }
+}
+
+
+static void RS_TARGET("ssse3")
+unpack_deint3_16_ssse3(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    deint3_16_ssse3(srcp, dstp, width, 0);
+}
+
+
+static void RS_TARGET("ssse3")
+unpack_deint3_16be_ssse3(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    deint3_16_ssse3(srcp, dstp, width, 1);
+}
+
+
+static void RS_TARGET("ssse3")
+unpack_deint2_16be_ssse3(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    const __m128i shuf = LOADU(deint2_16be_shuf);
+    int x = 0;
+
+    for (; x + 8 <= width; x += 8) {
+        __m128i a = _mm_shuffle_epi8(LOADU(srcp + 4 * x), shuf);
+        __m128i b = _mm_shuffle_epi8(LOADU(srcp + 4 * x + 16), shuf);
+        STOREU(dstp[0] + 2 * x, _mm_unpacklo_epi64(a, b));
+        STOREU(dstp[1] + 2 * x, _mm_unpackhi_epi64(a, b));
+    }
+    if (x < width) {
+        uint8_t *rest[2] = { dstp[0] + 2 * x, dstp[1] + 2 * x };
+        unpack_deint2_16be_c(srcp + 4 * x, rest, width - x);
+    }
+}
+
+
+/* size is the sample size, 2 or 4 bytes. */
+static inline void RS_TARGET("ssse3")
+swap_ssse3(const uint8_t *srcp, uint8_t **dstp, int width, int size)
+{
+    const __m128i shuf = LOADU(size == 2 ? swap16_shuf : swap32_shuf);
+    int x = 0;
+
+    for (; x + 16 <= width * size; x += 16) {
+        STOREU(dstp[0] + x, _mm_shuffle_epi8(LOADU(srcp + x), shuf));
+    }
+    if (x < width * size) {
+        uint8_t *rest[1] = { dstp[0] + x };
+        if (size == 2) {
+            unpack_swap16_c(srcp + x, rest, width - x / 2);
+        } else {
+            unpack_swap32_c(srcp + x, rest, width - x / 4);
+        }
+    }
+}
+
+
+static void RS_TARGET("ssse3")
+unpack_swap16_ssse3(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    swap_ssse3(srcp, dstp, width, 2);
+}
+
+
+static void RS_TARGET("ssse3")
+unpack_swap32_ssse3(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    swap_ssse3(srcp, dstp, width, 4);
+}
+
+
+static void RS_TARGET("ssse3")
+unpack_deint4_8_ssse3(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    const __m128i shuf = LOADU(deint4_8_shuf);
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        const uint8_t *s = srcp + 4 * x;
+        /* each register ends up holding 4 pixels as c0c0c0c0 c1c1c1c1 ..,
+           a 4x4 dword transpose then lines the components up. */
+        __m128i t0 = _mm_shuffle_epi8(LOADU(s), shuf);
+        __m128i t1 = _mm_shuffle_epi8(LOADU(s + 16), shuf);
+        __m128i t2 = _mm_shuffle_epi8(LOADU(s + 32), shuf);
+        __m128i t3 = _mm_shuffle_epi8(LOADU(s + 48), shuf);
+        __m128i u0 = _mm_unpacklo_epi32(t0, t1);
+        __m128i u1 = _mm_unpacklo_epi32(t2, t3);
+        __m128i u2 = _mm_unpackhi_epi32(t0, t1);
+        __m128i u3 = _mm_unpackhi_epi32(t2, t3);
+        STOREU(dstp[0] + x, _mm_unpacklo_epi64(u0, u1));
+        STOREU(dstp[1] + x, _mm_unpackhi_epi64(u0, u1));
+        STOREU(dstp[2] + x, _mm_unpacklo_epi64(u2, u3));
+        STOREU(dstp[3] + x, _mm_unpackhi_epi64(u2, u3));
+    }
+    if (x < width) {
+        uint8_t *rest[4] = { dstp[0] + x, dstp[1] + x, dstp[2] + x, dstp[3] + x };
+        unpack_deint4_8_c(srcp + 4 * x, rest, width - x);
+    }
+}
+
+
+/* factor blocks of 16 bytes shrink to 16 / factor bytes each, which
+   are interleaved back together in source order. */
+static inline __m128i RS_TARGET("ssse3")
+decimate_block(const uint8_t *s, __m128i shuf, int factor)
+{
+    __m128i p[8];
+    for (int k = 0; k < factor; k++) {
+        p[k] = _mm_shuffle_epi8(LOADU(s + 16 * k), shuf);
+    }
+    if (factor == 8) {
+        for (int k = 0; k < 4; k++) {
+            p[k] = _mm_unpacklo_epi16(p[2 * k], p[2 * k + 1]);
+        }
+    }
+    if (factor >= 4) {
+        for (int k = 0; k < 2; k++) {
+            p[k] = _mm_unpacklo_epi32(p[2 * k], p[2 * k + 1]);
+        }
+    }
+    return _mm_unpacklo_epi64(p[0], p[1]);
+}
+
+
+static inline int RS_TARGET("ssse3")
+decimate_ssse3(const uint8_t *srcp, uint8_t *dstp, int num_units, int unit,
+               int log_unit, int factor, int log_factor)
+{
+    const __m128i shuf = LOADU(decimate_shuf[log_unit][log_factor - 1]);
+    int step = 16 >> log_unit;
+    int x = 0;
+
+    for (; x + step <= num_units; x += step) {
+        STOREU(dstp + unit * x,
+               decimate_block(srcp + (size_t)unit * factor * x, shuf, factor));
+    }
+    return x;
+}
+
+
+#define DEFINE_DECIMATE_SSSE3(unit, log_unit)                                 \
+static void RS_TARGET("ssse3")                                                \
+decimate_##unit##_ssse3(const uint8_t *srcp, uint8_t *dstp, int num_units,    \
+                        int factor)                                           \
+{                                                                             \
+    int x = 0;                                                                \
+    if (factor == 2) {                                                        \
+        x = decimate_ssse3(srcp, dstp, num_units, unit, log_unit, 2, 1);      \
+    } else if (factor == 4) {                                                 \
+        x = decimate_ssse3(srcp, dstp, num_units, unit, log_unit, 4, 2);      \
+    } else if (factor == 8 && unit < 4) {                                     \
+        x = decimate_ssse3(srcp, dstp, num_units, unit, log_unit, 8, 3);      \
+    }                                                                         \
+    decimate_##unit##_c(srcp + (size_t)unit * factor * x, dstp + unit * x,    \
+                        num_units - x, factor);                               \
+}
+
+DEFINE_DECIMATE_SSSE3(1, 0)
+DEFINE_DECIMATE_SSSE3(2, 1)
+DEFINE_DECIMATE_SSSE3(4, 2)
+
+#undef DEFINE_DECIMATE_SSSE3
+
+
+/* avx2 shuffles and packs work within 128 bit lanes. the kernels either
+   load blocks which are a lane apart in the output (load2x128), or
+   restore the order after packing (pack_ordered). avx-512 does the same
+   with four lanes. */
+static inline __m256i RS_TARGET("avx2")
+load2x128(const uint8_t *p, int step)
+{
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(LOADU(p)), LOADU(p + step), 1);
+}
+
+
+static inline __m256i RS_TARGET("avx2")
+broadcast128(const int8_t *p)
+{
+    return _mm256_broadcastsi128_si256(LOADU(p));
+}
+
+
+static inline __m256i RS_TARGET("avx2")
+pack_ordered_u8(__m256i a, __m256i b)
+{
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8);
+}
+
+
+static void RS_TARGET("avx2")
+unpack_deint2_8_avx2(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00ff);
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32) {
+        __m256i a = LOADU256(srcp + 2 * x);
+        __m256i b = LOADU256(srcp + 2 * x + 32);
+        STOREU256(dstp[0] + x, pack_ordered_u8(_mm256_and_si256(a, mask),
+                                               _mm256_and_si256(b, mask)));
+        STOREU256(dstp[1] + x, pack_ordered_u8(_mm256_srli_epi16(a, 8),
+                                               _mm256_srli_epi16(b, 8)));
+    }
+    if (x < width) {
+        uint8_t *rest[2] = { dstp[0] + x, dstp[1] + x };
+        unpack_deint2_8_sse2(srcp + 2 * x, rest, width - x);
+    }
+}
+
+
+static void RS_TARGET("avx2")
+unpack_deint2_16_avx2(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        __m256i a = LOADU256(srcp + 4 * x);
+        __m256i b = LOADU256(srcp + 4 * x + 32);
+        __m256i lo_a = _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16);
+        __m256i lo_b = _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16);
+        __m256i hi_a = _mm256_srai_epi32(a, 16);
+        __m256i hi_b = _mm256_srai_epi32(b, 16);
+        STOREU256(dstp[0] + 2 * x,
+                  _mm256_permute4x64_epi64(_mm256_packs_epi32(lo_a, lo_b), 0xd8));
+        STOREU256(dstp[1] + 2 * x,
+                  _mm256_permute4x64_epi64(_mm256_packs_epi32(hi_a, hi_b), 0xd8));
+    }
+    if (x < width) {
+        uint8_t *rest[2] = { dstp[0] + 2 * x, dstp[1] + 2 * x };
+        unpack_deint2_16_sse2(srcp + 4 * x, rest, width - x);
+    }
+}
+
+
+static inline void RS_TARGET("avx2")
+unpack_422_avx2(const uint8_t *srcp, uint8_t **dstp, int width, int uyvy)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00ff);
+    int x = 0;
+
+    for (; x + 64 <= width; x += 64) {
+        const uint8_t *s = srcp + 2 * x;
+        __m256i a = LOADU256(s);
+        __m256i b = LOADU256(s + 32);
+        __m256i c = LOADU256(s + 64);
+        __m256i d = LOADU256(s + 96);
+        __m256i even0 = pack_ordered_u8(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+        __m256i even1 = pack_ordered_u8(_mm256_and_si256(c, mask), _mm256_and_si256(d, mask));
+        __m256i odd0 = pack_ordered_u8(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        __m256i odd1 = pack_ordered_u8(_mm256_srli_epi16(c, 8), _mm256_srli_epi16(d, 8));
+        __m256i chroma0 = uyvy ? even0 : odd0;
+        __m256i chroma1 = uyvy ? even1 : odd1;
+        STOREU256(dstp[0] + x, uyvy ? odd0 : even0);
+        STOREU256(dstp[0] + x + 32, uyvy ? odd1 : even1);
+        STOREU256(dstp[1] + x / 2, pack_ordered_u8(_mm256_and_si256(chroma0, mask),
+                                                   _mm256_and_si256(chroma1, mask)));
+        STOREU256(dstp[2] + x / 2, pack_ordered_u8(_mm256_srli_epi16(chroma0, 8),
+                                                   _mm256_srli_epi16(chroma1, 8)));
+    }
+    if (x < width) {
+        uint8_t *rest[3] = { dstp[0] + x, dstp[1] + x / 2, dstp[2] + x / 2 };
+        unpack_422_sse2(srcp + 2 * x, rest, width - x, uyvy);
+    }
+}
+
+
+static void RS_TARGET("avx2")
+unpack_yuyv_avx2(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    unpack_422_avx2(srcp, dstp, width, 0);
+}
+
+
+static void RS_TARGET("avx2")
+unpack_uyvy_avx2(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    unpack_422_avx2(srcp, dstp, width, 1);
+}
+
+
+static inline __m256i RS_TARGET("avx2")
+gather3_avx2(__m256i a, __m256i b, __m256i c, const int8_t (*shuf)[16])
+{
+    return _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a, broadcast128(shuf[0])),
+                                           _mm256_shuffle_epi8(b, broadcast128(shuf[1]))),
+                           _mm256_shuffle_epi8(c, broadcast128(shuf[2])));
+}
+
+
+static void RS_TARGET("avx2")
+unpack_deint3_8_avx2(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32) {
+        const uint8_t *s = srcp + 3 * x;
+        __m256i a = load2x128(s, 48);
+        __m256i b = load2x128(s + 16, 48);
+        __m256i c = load2x128(s + 32, 48);
+        for (int k = 0; k < 3; k++) {
+            STOREU256(dstp[k] + x, gather3_avx2(a, b, c, deint3_8_shuf[k]));
+        }
+    }
+    if (x < width) {
+        uint8_t *rest[3] = { dstp[0] + x, dstp[1] + x, dstp[2] + x };
+        unpack_deint3_8_ssse3(srcp + 3 * x, rest, width - x);
+    }
+}
+
+
+static inline void RS_TARGET("avx2")
+deint3_16_avx2(const uint8_t *srcp, uint8_t **dstp, int width, int be)
+{
+    const int8_t (*shuf)[3][16] = be ? deint3_16be_shuf : deint3_16_shuf;
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        const uint8_t *s = srcp + 6 * x;
+        __m256i a = load2x128(s, 48);
+        __m256i b = load2x128(s + 16, 48);
+        __m256i c = load2x128(s + 32, 48);
+        for (int k = 0; k < 3; k++) {
+            STOREU256(dstp[k] + 2 * x, gather3_avx2(a, b, c, shuf[k]));
+        }
+    }
+    if (x < width) {
+        uint8_t *rest[3] = { dstp[0] + 2 * x, dstp[1] + 2 * x, dstp[2] + 2 * x };
+        deint3_16_ssse3(srcp + 6 * x, rest, width - x, be);
+    }
+}
+
+
+static void RS_TARGET("avx2")
+unpack_deint3_16_avx2(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    deint3_16_avx2(srcp, dstp, width, 0);
+}
+
+
+static void RS_TARGET("avx2")
+unpack_deint3_16be_avx2(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    deint3_16_avx2(srcp, dstp, width, 1);
+}
+
+
+static void RS_TARGET("avx2")
+unpack_deint2_16be_avx2(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    const __m256i shuf = broadcast128(deint2_16be_shuf);
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        __m256i a = _mm256_shuffle_epi8(LOADU256(srcp + 4 * x), shuf);
+        __m256i b = _mm256_shuffle_epi8(LOADU256(srcp + 4 * x + 32), shuf);
+        STOREU256(dstp[0] + 2 * x,
+                  _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(a, b), 0xd8));
+        STOREU256(dstp[1] + 2 * x,
+                  _mm256_permute4x64_epi64(_mm256_unpackhi_epi64(a, b), 0xd8));
+    }
+    if (x < width) {
+        uint8_t *rest[2] = { dstp[0] + 2 * x, dstp[1] + 2 * x };
+        unpack_deint2_16be_ssse3(srcp + 4 * x, rest, width - x);
+    }
+}
+
+
+static inline void RS_TARGET("avx2")
+swap_avx2(const uint8_t *srcp, uint8_t **dstp, int width, int size)
+{
+    const __m256i shuf = broadcast128(size == 2 ? swap16_shuf : swap32_shuf);
+    int x = 0;
+
+    for (; x + 32 <= width * size; x += 32) {
+        STOREU256(dstp[0] + x, _mm256_shuffle_epi8(LOADU256(srcp + x), shuf));
+    }
+    if (x < width * size) {
+        uint8_t *rest[1] = { dstp[0] + x };
+        swap_ssse3(srcp + x, rest, width - x / size, size);
+    }
+}
+
+
+static void RS_TARGET("avx2")
+unpack_swap16_avx2(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    swap_avx2(srcp, dstp, width, 2);
+}
+
+
+static void RS_TARGET("avx2")
+unpack_swap32_avx2(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    swap_avx2(srcp, dstp, width, 4);
+}
+
+
+static void RS_TARGET("avx2")
+unpack_deint4_8_avx2(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    const __m256i shuf = broadcast128(deint4_8_shuf);
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32) {
+        const uint8_t *s = srcp + 4 * x;
+        __m256i t0 = _mm256_shuffle_epi8(load2x128(s, 64), shuf);
+        __m256i t1 = _mm256_shuffle_epi8(load2x128(s + 16, 64), shuf);
+        __m256i t2 = _mm256_shuffle_epi8(load2x128(s + 32, 64), shuf);
+        __m256i t3 = _mm256_shuffle_epi8(load2x128(s + 48, 64), shuf);
+        __m256i u0 = _mm256_unpacklo_epi32(t0, t1);
+        __m256i u1 = _mm256_unpacklo_epi32(t2, t3);
+        __m256i u2 = _mm256_unpackhi_epi32(t0, t1);
+        __m256i u3 = _mm256_unpackhi_epi32(t2, t3);
+        STOREU256(dstp[0] + x, _mm256_unpacklo_epi64(u0, u1));
+        STOREU256(dstp[1] + x, _mm256_unpackhi_epi64(u0, u1));
+        STOREU256(dstp[2] + x, _mm256_unpacklo_epi64(u2, u3));
+        STOREU256(dstp[3] + x, _mm256_unpackhi_epi64(u2, u3));
+    }
+    if (x < width) {
+        uint8_t *rest[4] = { dstp[0] + x, dstp[1] + x, dstp[2] + x, dstp[3] + x };
+        unpack_deint4_8_ssse3(srcp + 4 * x, rest, width - x);
+    }
+}
+
+static inline __m512i RS_TARGET("avx512bw")
+load4x128(const uint8_t *p, int step)
+{
+    __m512i v = _mm512_castsi128_si512(LOADU(p));
+    v = _mm512_inserti32x4(v, LOADU(p + step), 1);
+    v = _mm512_inserti32x4(v, LOADU(p + 2 * step), 2);
+    return _mm512_inserti32x4(v, LOADU(p + 3 * step), 3);
+}
+
+
+static inline __m512i RS_TARGET("avx512bw")
+broadcast4x128(const int8_t *p)
+{
+    return _mm512_broadcast_i32x4(LOADU(p));
+}
+
+
+static inline __m512i RS_TARGET("avx512bw")
+order_lanes(__m512i v)
+{
+    return _mm512_permutexvar_epi64(_mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7), v);
+}
+
+
+static inline __m512i RS_TARGET("avx512bw")
+pack_ordered_u8_512(__m512i a, __m512i b)
+{
+    return order_lanes(_mm512_packus_epi16(a, b));
+}
+
+
+static void RS_TARGET("avx512bw")
+unpack_deint2_8_avx512(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    const __m512i mask = _mm512_set1_epi16(0x00ff);
+    int x = 0;
+
+    for (; x + 64 <= width; x += 64) {
+        __m512i a = LOADU512(srcp + 2 * x);
+        __m512i b = LOADU512(srcp + 2 * x + 64);
+        STOREU512(dstp[0] + x, pack_ordered_u8_512(_mm512_and_si512(a, mask),
+                                                   _mm512_and_si512(b, mask)));
+        STOREU512(dstp[1] + x, pack_ordered_u8_512(_mm512_srli_epi16(a, 8),
+                                                   _mm512_srli_epi16(b, 8)));
+    }
+    if (x < width) {
+        uint8_t *rest[2] = { dstp[0] + x, dstp[1] + x };
+        unpack_deint2_8_avx2(srcp + 2 * x, rest, width - x);
+    }
+}
+
+
+static void RS_TARGET("avx512bw")
+unpack_deint2_16_avx512(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32) {
+        __m512i a = LOADU512(srcp + 4 * x);
+        __m512i b = LOADU512(srcp + 4 * x + 64);
+        __m512i lo_a = _mm512_srai_epi32(_mm512_slli_epi32(a, 16), 16);
+        __m512i lo_b = _mm512_srai_epi32(_mm512_slli_epi32(b, 16), 16);
+        __m512i hi_a = _mm512_srai_epi32(a, 16);
+        __m512i hi_b = _mm512_srai_epi32(b, 16);
+        STOREU512(dstp[0] + 2 * x, order_lanes(_mm512_packs_epi32(lo_a, lo_b)));
+        STOREU512(dstp[1] + 2 * x, order_lanes(_mm512_packs_epi32(hi_a, hi_b)));
+    }
+    if (x < width) {
+        uint8_t *rest[2] = { dstp[0] + 2 * x, dstp[1] + 2 * x };
+        unpack_deint2_16_avx2(srcp + 4 * x, rest, width - x);
+    }
+}
+
+
+static inline void RS_TARGET("avx512bw")
+unpack_422_avx512(const uint8_t *srcp, uint8_t **dstp, int width, int uyvy)
+{
+    const __m512i mask = _mm512_set1_epi16(0x00ff);
+    int x = 0;
+
+    for (; x + 128 <= width; x += 128) {
+        const uint8_t *s = srcp + 2 * x;
+        __m512i a = LOADU512(s);
+        __m512i b = LOADU512(s + 64);
+        __m512i c = LOADU512(s + 128);
+        __m512i d = LOADU512(s + 192);
+        __m512i even0 = pack_ordered_u8_512(_mm512_and_si512(a, mask), _mm512_and_si512(b, mask));
+        __m512i even1 = pack_ordered_u8_512(_mm512_and_si512(c, mask), _mm512_and_si512(d, mask));
+        __m512i odd0 = pack_ordered_u8_512(_mm512_srli_epi16(a, 8), _mm512_srli_epi16(b, 8));
+        __m512i odd1 = pack_ordered_u8_512(_mm512_srli_epi16(c, 8), _mm512_srli_epi16(d, 8));
+        __m512i chroma0 = uyvy ? even0 : odd0;
+        __m512i chroma1 = uyvy ? even1 : odd1;
+        STOREU512(dstp[0] + x, uyvy ? odd0 : even0);
+        STOREU512(dstp[0] + x + 64, uyvy ? odd1 : even1);
+        STOREU512(dstp[1] + x / 2, pack_ordered_u8_512(_mm512_and_si512(chroma0, mask),
+                                                       _mm512_and_si512(chroma1, mask)));
+        STOREU512(dstp[2] + x / 2, pack_ordered_u8_512(_mm512_srli_epi16(chroma0, 8),
+                                                       _mm512_srli_epi16(chroma1, 8)));
+    }
+    if (x < width) {
+        uint8_t *rest[3] = { dstp[0] + x, dstp[1] + x / 2, dstp[2] + x / 2 };
+        unpack_422_avx2(srcp + 2 * x, rest, width - x, uyvy);
+    }
+}
+
+
+static void RS_TARGET("avx512bw")
+unpack_yuyv_avx512(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    unpack_422_avx512(srcp, dstp, width, 0);
+}
+
+
+static void RS_TARGET("avx512bw")
+unpack_uyvy_avx512(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    unpack_422_avx512(srcp, dstp, width, 1);
+}
+
+
+static inline __m512i RS_TARGET("avx512bw")
+gather3_avx512(__m512i a, __m512i b, __m512i c, const int8_t (*shuf)[16])
+{
+    return _mm512_or_si512(_mm512_or_si512(_mm512_shuffle_epi8(a, broadcast4x128(shuf[0])),
+                                           _mm512_shuffle_epi8(b, broadcast4x128(shuf[1]))),
+                           _mm512_shuffle_epi8(c, broadcast4x128(shuf[2])));
+}
+
+
+static void RS_TARGET("avx512bw")
+unpack_deint3_8_avx512(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    int x = 0;
+
+    for (; x + 64 <= width; x += 64) {
+        const uint8_t *s = srcp + 3 * x;
+        __m512i a = load4x128(s, 48);
+        __m512i b = load4x128(s + 16, 48);
+        __m512i c = load4x128(s + 32, 48);
+        for (int k = 0; k < 3; k++) {
+            STOREU512(dstp[k] + x, gather3_avx512(a, b, c, deint3_8_shuf[k]));
+        }
+    }
+    if (x < width) {
+        uint8_t *rest[3] = { dstp[0] + x, dstp[1] + x, dstp[2] + x };
+        unpack_deint3_8_avx2(srcp + 3 * x, rest, width - x);
+    }
+}
+
+
+static inline void RS_TARGET("avx512bw")
+deint3_16_avx512(const uint8_t *srcp, uint8_t **dstp, int width, int be)
+{
+    const int8_t (*shuf)[3][16] = be ? deint3_16be_shuf : deint3_16_shuf;
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32) {
+        const uint8_t *s = srcp + 6 * x;
+        __m512i a = load4x128(s, 48);
+        __m512i b = load4x128(s + 16, 48);
+        __m512i c = load4x128(s + 32, 48);
+        for (int k = 0; k < 3; k++) {
+            STOREU512(dstp[k] + 2 * x, gather3_avx512(a, b, c, shuf[k]));
+        }
+    }
+    if (x < width) {
+        uint8_t *rest[3] = { dstp[0] + 2 * x, dstp[1] + 2 * x, dstp[2] + 2 * x };
+        deint3_16_avx2(srcp + 6 * x, rest, width - x, be);
+    }
+}
+
+
+static void RS_TARGET("avx512bw")
+unpack_deint3_16_avx512(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    deint3_16_avx512(srcp, dstp, width, 0);
+}
+
+
+static void RS_TARGET("avx512bw")
+unpack_deint3_16be_avx512(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    deint3_16_avx512(srcp, dstp, width, 1);
+}
+
+
+static void RS_TARGET("avx512bw")
+unpack_deint2_16be_avx512(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    const __m512i shuf = broadcast4x128(deint2_16be_shuf);
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32) {
+        __m512i a = _mm512_shuffle_epi8(LOADU512(srcp + 4 * x), shuf);
+        __m512i b = _mm512_shuffle_epi8(LOADU512(srcp + 4 * x + 64), shuf);
+        STOREU512(dstp[0] + 2 * x, order_lanes(_mm512_unpacklo_epi64(a, b)));
+        STOREU512(dstp[1] + 2 * x, order_lanes(_mm512_unpackhi_epi64(a, b)));
+    }
+    if (x < width) {
+        uint8_t *rest[2] = { dstp[0] + 2 * x, dstp[1] + 2 * x };
+        unpack_deint2_16be_avx2(srcp + 4 * x, rest, width - x);
+    }
+}
+
+
+static inline void RS_TARGET("avx512bw")
+swap_avx512(const uint8_t *srcp, uint8_t **dstp, int width, int size)
+{
+    const __m512i shuf = broadcast4x128(size == 2 ? swap16_shuf : swap32_shuf);
+    int x = 0;
+
+    for (; x + 64 <= width * size; x += 64) {
+        STOREU512(dstp[0] + x, _mm512_shuffle_epi8(LOADU512(srcp + x), shuf));
+    }
+    if (x < width * size) {
+        uint8_t *rest[1] = { dstp[0] + x };
+        swap_avx2(srcp + x, rest, width - x / size, size);
+    }
+}
+
+
+static void RS_TARGET("avx512bw")
+unpack_swap16_avx512(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    swap_avx512(srcp, dstp, width, 2);
+}
+
+
+static void RS_TARGET("avx512bw")
+unpack_swap32_avx512(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    swap_avx512(srcp, dstp, width, 4);
+}
+
+
+static void RS_TARGET("avx512bw")
+unpack_deint4_8_avx512(const uint8_t *srcp, uint8_t **dstp, int width)
+{
+    const __m512i shuf = broadcast4x128(deint4_8_shuf);
+    int x = 0;
+
+    for (; x + 64 <= width; x += 64) {
+        const uint8_t *s = srcp + 4 * x;
+        __m512i t0 = _mm512_shuffle_epi8(load4x128(s, 64), shuf);
+        __m512i t1 = _mm512_shuffle_epi8(load4x128(s + 16, 64), shuf);
+        __m512i t2 = _mm512_shuffle_epi8(load4x128(s + 32, 64), shuf);
+        __m512i t3 = _mm512_shuffle_epi8(load4x128(s + 48, 64), shuf);
+        __m512i u0 = _mm512_unpacklo_epi32(t0, t1);
+        __m512i u1 = _mm512_unpacklo_epi32(t2, t3);
+        __m512i u2 = _mm512_unpackhi_epi32(t0, t1);
+        __m512i u3 = _mm512_unpackhi_epi32(t2, t3);
+        STOREU512(dstp[0] + x, _mm512_unpacklo_epi64(u0, u1));
+        STOREU512(dstp[1] + x, _mm512_unpackhi_epi64(u0, u1));
+        STOREU512(dstp[2] + x, _mm512_unpacklo_epi64(u2, u3));
+        STOREU512(dstp[3] + x, _mm512_unpackhi_epi64(u2, u3));
+    }
+    if (x < width) {
+        uint8_t *rest[4] = { dstp[0] + x, dstp[1] + x, dstp[2] + x, dstp[3] + x };
+        unpack_deint4_8_avx2(srcp + 4 * x, rest, width - x);
+    }
+}
+
+
+/* integer conversions run every sample through the rounding add, the
+   right shift and the left shift, whichever of them does not apply
+   being zero, and clamp it. sse2 has no unsigned 16 bit minimum, so
+   min(v, max) is v - sat(v - max) there. */
+#define CONVERT_INT_SETUP(type, set1_epi16)                                   \
+    int right = cv->shift < 0 ? -cv->shift : 0;                               \
+    const __m128i shr = _mm_cvtsi32_si128(right);                             \
+    const __m128i shl = _mm_cvtsi32_si128(right ? 0 : cv->shift);             \
+    const type round = set1_epi16((int16_t)(right ? 1 << (right - 1) : 0));   \
+    const type max = set1_epi16((int16_t)cv->max)
+
+static inline __m128i RS_TARGET("sse2")
+convert_int_sse2(__m128i v, __m128i round, __m128i shr, __m128i shl,
+                 __m128i max)
+{
+    v = _mm_sll_epi16(_mm_srl_epi16(_mm_adds_epu16(v, round), shr), shl);
+    return _mm_sub_epi16(v, _mm_subs_epu16(v, max));
+}
+
+
+static void RS_TARGET("sse2")
+convert_u8_u16_sse2(const uint8_t *srcp, uint8_t *dstp, int width,
+                    const rs_convert_t *cv)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i shl = _mm_cvtsi32_si128(cv->shift);
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        __m128i v = LOADU(srcp + x);
+        STOREU(dstp + 2 * x, _mm_sll_epi16(_mm_unpacklo_epi8(v, zero), shl));
+        STOREU(dstp + 2 * x + 16, _mm_sll_epi16(_mm_unpackhi_epi8(v, zero), shl));
+    }
+    convert_u8_u16_c(srcp + x, dstp + 2 * x, width - x, cv);
+}
+
+
+static void RS_TARGET("sse2")
+convert_u16_u8_sse2(const uint8_t *srcp, uint8_t *dstp, int width,
+                    const rs_convert_t *cv)
+{
+    CONVERT_INT_SETUP(__m128i, _mm_set1_epi16);
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = convert_int_sse2(LOADU(srcp + 2 * x), round, shr, shl, max);
+        __m128i b = convert_int_sse2(LOADU(srcp + 2 * x + 16), round, shr, shl, max);
+        STOREU(dstp + x, _mm_packus_epi16(a, b));
+    }
+    convert_u16_u8_c(srcp + 2 * x, dstp + x, width - x, cv);
+}
+
+
+static void RS_TARGET("sse2")
+convert_u16_u16_sse2(const uint8_t *srcp, uint8_t *dstp, int width,
+                     const rs_convert_t *cv)
+{
+    CONVERT_INT_SETUP(__m128i, _mm_set1_epi16);
+    int x = 0;
+
+    for (; x + 8 <= width; x += 8) {
+        STOREU(dstp + 2 * x,
+               convert_int_sse2(LOADU(srcp + 2 * x), round, shr, shl, max));
+    }
+    convert_u16_u16_c(srcp + 2 * x, dstp + 2 * x, width - x, cv);
+}
+
+
+static inline void RS_TARGET("sse2")
+store_f32_sse2(uint8_t *dstp, __m128i v, __m128i bias, __m128 scale)
+{
+    __m128 f = _mm_cvtepi32_ps(_mm_add_epi32(v, bias));
+    _mm_storeu_ps((float *)dstp, _mm_mul_ps(f, scale));
+}
+
+
+static void RS_TARGET("sse2")
+convert_u8_f32_sse2(const uint8_t *srcp, uint8_t *dstp, int width,
+                    const rs_convert_t *cv)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi32(cv->bias);
+    const __m128 scale = _mm_set1_ps(cv->scale);
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        __m128i v = LOADU(srcp + x);
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        uint8_t *d = dstp + 4 * x;
+        store_f32_sse2(d, _mm_unpacklo_epi16(lo, zero), bias, scale);
+        store_f32_sse2(d + 16, _mm_unpackhi_epi16(lo, zero), bias, scale);
+        store_f32_sse2(d + 32, _mm_unpacklo_epi16(hi, zero), bias, scale);
+        store_f32_sse2(d + 48, _mm_unpackhi_epi16(hi, zero), bias, scale);
+    }
+    convert_u8_f32_c(srcp + x, dstp + 4 * x, width - x, cv);
+}
+
+
+static void RS_TARGET("sse2")
+convert_u16_f32_sse2(const uint8_t *srcp, uint8_t *dstp, int width,
+                     const rs_convert_t *cv)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi32(cv->bias);
+    const __m128 scale = _mm_set1_ps(cv->scale);
+    int x = 0;
+
+    for (; x + 8 <= width; x += 8) {
+        __m128i v = LOADU(srcp + 2 * x);
+        store_f32_sse2(dstp + 4 * x, _mm_unpacklo_epi16(v, zero), bias, scale);
+        store_f32_sse2(dstp + 4 * x + 16, _mm_unpackhi_epi16(v, zero), bias, scale);
+    }
+    convert_u16_f32_c(srcp + 2 * x, dstp + 4 * x, width - x, cv);
+}
+
+
+static inline __m256i RS_TARGET("avx2")
+convert_int_avx2(__m256i v, __m256i round, __m128i shr, __m128i shl,
+                 __m256i max)
+{
+    v = _mm256_sll_epi16(_mm256_srl_epi16(_mm256_adds_epu16(v, round), shr), shl);
+    return _mm256_min_epu16(v, max);
+}
+
+
+static void RS_TARGET("avx2")
+convert_u8_u16_avx2(const uint8_t *srcp, uint8_t *dstp, int width,
+                    const rs_convert_t *cv)
+{
+    const __m128i shl = _mm_cvtsi32_si128(cv->shift);
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        STOREU256(dstp + 2 * x,
+                  _mm256_sll_epi16(_mm256_cvtepu8_epi16(LOADU(srcp + x)), shl));
+    }
+    convert_u8_u16_c(srcp + x, dstp + 2 * x, width - x, cv);
+}
+
+
+static void RS_TARGET("avx2")
+convert_u16_u8_avx2(const uint8_t *srcp, uint8_t *dstp, int width,
+                    const rs_convert_t *cv)
+{
+    CONVERT_INT_SETUP(__m256i, _mm256_set1_epi16);
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32) {
+        __m256i a = convert_int_avx2(LOADU256(srcp + 2 * x), round, shr, shl, max);
+        __m256i b = convert_int_avx2(LOADU256(srcp + 2 * x + 32), round, shr, shl, max);
+        STOREU256(dstp + x,
+                  _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8));
+    }
+    convert_u16_u8_c(srcp + 2 * x, dstp + x, width - x, cv);
+}
+
+
+static void RS_TARGET("avx2")
+convert_u16_u16_avx2(const uint8_t *srcp, uint8_t *dstp, int width,
+                     const rs_convert_t *cv)
+{
+    CONVERT_INT_SETUP(__m256i, _mm256_set1_epi16);
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        STOREU256(dstp + 2 * x,
+                  convert_int_avx2(LOADU256(srcp + 2 * x), round, shr, shl, max));
+    }
+    convert_u16_u16_c(srcp + 2 * x, dstp + 2 * x, width - x, cv);
+}
+
+#undef CONVERT_INT_SETUP
+
+
+static inline __m256 RS_TARGET("avx2")
+to_float_avx2(__m256i v, __m256i bias, __m256 scale)
+{
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(v, bias)), scale);
+}
+
+#define LOAD_U8x8(p) _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(p)))
+#define LOAD_U16x8(p) _mm256_cvtepu16_epi32(LOADU(p))
+#define STORE_F32x8(p, v) _mm256_storeu_ps((float *)(p), v)
+#define STORE_F16x8(p, v) \
+    STOREU(p, _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT))
+
+/* half float output needs f16c, which every avx2 cpu has and the avx2
+   level is only detected along with. */
+#define DEFINE_CONVERT_FLOAT_AVX2(name, target, load, src_size, store,        \
+                                  dst_size, tail)                             \
+static void RS_TARGET(target)                                                 \
+name(const uint8_t *srcp, uint8_t *dstp, int width, const rs_convert_t *cv)  \
+{                                                                             \
+    const __m256i bias = _mm256_set1_epi32(cv->bias);                         \
+    const __m256 scale = _mm256_set1_ps(cv->scale);                           \
+    int x = 0;                                                                \
+    for (; x + 8 <= width; x += 8) {                                          \
+        store(dstp + dst_size * x,                                            \
+              to_float_avx2(load(srcp + src_size * x), bias, scale));         \
+    }                                                                         \
+    tail(srcp + src_size * x, dstp + dst_size * x, width - x, cv);            \
+}
+
+DEFINE_CONVERT_FLOAT_AVX2(convert_u8_f32_avx2, "avx2", LOAD_U8x8, 1,
+                          STORE_F32x8, 4, convert_u8_f32_c)
+DEFINE_CONVERT_FLOAT_AVX2(convert_u16_f32_avx2, "avx2", LOAD_U16x8, 2,
+                          STORE_F32x8, 4, convert_u16_f32_c)
+DEFINE_CONVERT_FLOAT_AVX2(convert_u8_f16_avx2, "avx2,f16c", LOAD_U8x8, 1,
+                          STORE_F16x8, 2, convert_u8_f16_c)
+DEFINE_CONVERT_FLOAT_AVX2(convert_u16_f16_avx2, "avx2,f16c", LOAD_U16x8, 2,
+                          STORE_F16x8, 2, convert_u16_f16_c)
+
+#undef DEFINE_CONVERT_FLOAT_AVX2
+#undef LOAD_U8x8
+#undef LOAD_U16x8
+#undef STORE_F32x8
+#undef STORE_F16x8
+
+
+/* the rows are stored through aligned streaming stores; the unaligned
+   head and the tail of each row, shorter than one vector, are copied
+   normally. the closing sfence orders the streamed data before whatever
+   hands the frame to another thread. */
+#define DEFINE_STREAM_COPY(name, target, size, type, load, stream)           \
+static void RS_TARGET(target)                                                 \
+name(const uint8_t *srcp, int src_stride, uint8_t *dstp, int dst_stride,      \
+     int row_size, int height)                                                \
+{                                                                             \
+    for (int y = 0; y < height; y++) {                                        \
+        int head = (int)(-(uintptr_t)dstp & (size - 1));                      \
+        if (head > row_size) {                                                \
+            head = row_size;                                                  \
+        }                                                                     \
+        memcpy(dstp, srcp, head);                                             \
+        int x = head;                                                         \
+        for (; x + size <= row_size; x += size) {                             \
+            stream((type *)(dstp + x), load((const type *)(srcp + x)));       \
+        }                                                                     \
+        memcpy(dstp + x, srcp + x, row_size - x);                             \
+        srcp += src_stride;                                                   \
+        dstp += dst_stride;                                                   \
+    }                                                                         \
+    _mm_sfence();                                                             \
+}
+
+DEFINE_STREAM_COPY(stream_copy_sse2, "sse2", 16, __m128i, _mm_loadu_si128,
+                   _mm_stream_si128)
+DEFINE_STREAM_COPY(stream_copy_avx2, "avx2", 32, __m256i, _mm256_loadu_si256,
+                   _mm256_stream_si256)
+DEFINE_STREAM_COPY(stream_copy_avx512, "avx512bw", 64, __m512i,
+                   _mm512_loadu_si512, _mm512_stream_si512)
+
+#undef DEFINE_STREAM_COPY
+
+#undef LOADU
+#undef STOREU
+#undef LOADU256
+#undef STOREU256
+#undef LOADU512
+#undef STOREU512
+
+
+static void
+rs_cpuid(int leaf, int subleaf, uint32_t regs[4])
+{
+#ifdef _MSC_VER
+    int r[4];
+    __cpuidex(r, leaf, subleaf);
+    for (int i = 0; i < 4; i++) {
+        regs[i] = (uint32_t)r[i];
+    }
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+
+static uint64_t
+rs_xgetbv(void)
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+
+static rs_cpu_level_t detect_cpu_level(void)
+{
+    uint32_t regs[4];
+
+    rs_cpuid(0, 0, regs);
+    uint32_t max_leaf = regs[0];
+    if (max_leaf < 1) {
+        return RS_CPU_C;
+    }
+
+    rs_cpuid(1, 0, regs);
+    if (!(regs[3] & (1 << 26))) {
+        return RS_CPU_C;
+    }
+    if (!(regs[2] & (1 << 9))) {
+        return RS_CPU_SSE2;
+    }
+
+    /* the wider levels also need the os to save the extended registers. */
+    int osxsave = (regs[2] & (1 << 27)) && (regs[2] & (1 << 28));
+    int f16c = (regs[2] & (1 << 29)) != 0;
+    if (max_leaf < 7 || !osxsave) {
+        return RS_CPU_SSSE3;
+    }
+    uint64_t xcr0 = rs_xgetbv();
+    rs_cpuid(7, 0, regs);
+    if ((xcr0 & 0x6) != 0x6 || !(regs[1] & (1 << 5)) || !f16c) {
+        return RS_CPU_SSSE3;
+    }
+    if ((xcr0 & 0xe6) != 0xe6 || !(regs[1] & (1 << 16)) || !(regs[1] & (1u << 30))) {
+        return RS_CPU_AVX2;
+    }
+    return RS_CPU_AVX512BW;
+}
+
+#endif /* RS_ARCH_X86 */
+
+
+/* every kernel is listed here with the cpu level it needs. adding a
+   kernel only means adding its line, rs_get_unpack_row picks the highest
+   level usable for each kind. */
+static const struct {
+    unpack_kind_t kind;
+    rs_cpu_level_t level;
+    func_unpack_row func;
+} registry[] = {
+    { UNPACK_DEINT2_8,    RS_CPU_C,        unpack_deint2_8_c         },
+    { UNPACK_DEINT2_16,   RS_CPU_C,        unpack_deint2_16_c        },
+    { UNPACK_DEINT3_8,    RS_CPU_C,        unpack_deint3_8_c         },
+    { UNPACK_DEINT3_16,   RS_CPU_C,        unpack_deint3_16_c        },
+    { UNPACK_DEINT4_8,    RS_CPU_C,        unpack_deint4_8_c         },
+    { UNPACK_YUYV,        RS_CPU_C,        unpack_yuyv_c             },
+    { UNPACK_UYVY,        RS_CPU_C,        unpack_uyvy_c             },
+    { UNPACK_SWAP16,      RS_CPU_C,        unpack_swap16_c           },
+    { UNPACK_SWAP32,      RS_CPU_C,        unpack_swap32_c           },
+    { UNPACK_DEINT2_16BE, RS_CPU_C,        unpack_deint2_16be_c      },
+    { UNPACK_DEINT3_16BE, RS_CPU_C,        unpack_deint3_16be_c      },
+#ifdef RS_ARCH_X86
+    { UNPACK_DEINT2_8,    RS_CPU_SSE2,     unpack_deint2_8_sse2      },
+    { UNPACK_DEINT2_16,   RS_CPU_SSE2,     unpack_deint2_16_sse2     },
+    { UNPACK_YUYV,        RS_CPU_SSE2,     unpack_yuyv_sse2          },
+    { UNPACK_UYVY,        RS_CPU_SSE2,     unpack_uyvy_sse2          },
+    { UNPACK_DEINT3_8,    RS_CPU_SSSE3,    unpack_deint3_8_ssse3     },
+    { UNPACK_DEINT3_16,   RS_CPU_SSSE3,    unpack_deint3_16_ssse3    },
+    { UNPACK_DEINT4_8,    RS_CPU_SSSE3,    unpack_deint4_8_ssse3     },
+    { UNPACK_SWAP16,      RS_CPU_SSSE3,    unpack_swap16_ssse3       },
+    { UNPACK_SWAP32,      RS_CPU_SSSE3,    unpack_swap32_ssse3       },
+    { UNPACK_DEINT2_16BE, RS_CPU_SSSE3,    unpack_deint2_16be_ssse3  },
+    { UNPACK_DEINT3_16BE, RS_CPU_SSSE3,    unpack_deint3_16be_ssse3  },
+    { UNPACK_DEINT2_8,    RS_CPU_AVX2,     unpack_deint2_8_avx2      },
+    { UNPACK_DEINT2_16,   RS_CPU_AVX2,     unpack_deint2_16_avx2     },
+    { UNPACK_DEINT3_8,    RS_CPU_AVX2,     unpack_deint3_8_avx2      },
+    { UNPACK_DEINT3_16,   RS_CPU_AVX2,     unpack_deint3_16_avx2     },
+    { UNPACK_DEINT4_8,    RS_CPU_AVX2,     unpack_deint4_8_avx2      },
+    { UNPACK_YUYV,        RS_CPU_AVX2,     unpack_yuyv_avx2          },
+    { UNPACK_UYVY,        RS_CPU_AVX2,     unpack_uyvy_avx2          },
+    { UNPACK_SWAP16,      RS_CPU_AVX2,     unpack_swap16_avx2        },
+    { UNPACK_SWAP32,      RS_CPU_AVX2,     unpack_swap32_avx2        },
+    { UNPACK_DEINT2_16BE, RS_CPU_AVX2,     unpack_deint2_16be_avx2   },
+    { UNPACK_DEINT3_16BE, RS_CPU_AVX2,     unpack_deint3_16be_avx2   },
+    { UNPACK_DEINT2_8,    RS_CPU_AVX512BW, unpack_deint2_8_avx512    },
+    { UNPACK_DEINT2_16,   RS_CPU_AVX512BW, unpack_deint2_16_avx512   },
+    { UNPACK_DEINT3_8,    RS_CPU_AVX512BW, unpack_deint3_8_avx512    },
+    { UNPACK_DEINT3_16,   RS_CPU_AVX512BW, unpack_deint3_16_avx512   },
+    { UNPACK_DEINT4_8,    RS_CPU_AVX512BW, unpack_deint4_8_avx512    },
+    { UNPACK_YUYV,        RS_CPU_AVX512BW, unpack_yuyv_avx512        },
+    { UNPACK_UYVY,        RS_CPU_AVX512BW, unpack_uyvy_avx512        },
+    { UNPACK_SWAP16,      RS_CPU_AVX512BW, unpack_swap16_avx512      },
+    { UNPACK_SWAP32,      RS_CPU_AVX512BW, unpack_swap32_avx512      },
+    { UNPACK_DEINT2_16BE, RS_CPU_AVX512BW, unpack_deint2_16be_avx512 },
+    { UNPACK_DEINT3_16BE, RS_CPU_AVX512BW, unpack_deint3_16be_avx512 },
+#endif
+};
+
+static const struct {
+    rs_cpu_level_t level;
+    func_stream_copy func;
+} stream_copies[] = {
+#ifdef RS_ARCH_X86
+    { RS_CPU_SSE2,     stream_copy_sse2   },
+    { RS_CPU_AVX2,     stream_copy_avx2   },
+    { RS_CPU_AVX512BW, stream_copy_avx512 },
+#endif
+    { RS_CPU_C,        NULL               },
+};
+
+static const struct {
+    int unit;
+    rs_cpu_level_t level;
+    func_decimate_row func;
+} decimators[] = {
+    { 1, RS_CPU_C,     decimate_1_c     },
+    { 2, RS_CPU_C,     decimate_2_c     },
+    { 3, RS_CPU_C,     decimate_3_c     },
+    { 4, RS_CPU_C,     decimate_4_c     },
+    { 6, RS_CPU_C,     decimate_6_c     },
+    { 8, RS_CPU_C,     decimate_8_c     },
+#ifdef RS_ARCH_X86
+    { 1, RS_CPU_SSSE3, decimate_1_ssse3 },
+    { 2, RS_CPU_SSSE3, decimate_2_ssse3 },
+    { 4, RS_CPU_SSSE3, decimate_4_ssse3 },
+#endif
+};
+
+static const struct {
+    convert_kind_t kind;
+    rs_cpu_level_t level;
+    func_convert_row func;
+} converters[] = {
+    { CONVERT_U8_U16,  RS_CPU_C,    convert_u8_u16_c     },
+    { CONVERT_U16_U8,  RS_CPU_C,    convert_u16_u8_c     },
+    { CONVERT_U16_U16, RS_CPU_C,    convert_u16_u16_c    },
+    { CONVERT_U8_F32,  RS_CPU_C,    convert_u8_f32_c     },
+    { CONVERT_U16_F32, RS_CPU_C,    convert_u16_f32_c    },
+    { CONVERT_U8_F16,  RS_CPU_C,    convert_u8_f16_c     },
+    { CONVERT_U16_F16, RS_CPU_C,    convert_u16_f16_c    },
+#ifdef RS_ARCH_X86
+    { CONVERT_U8_U16,  RS_CPU_SSE2, convert_u8_u16_sse2  },
+    { CONVERT_U16_U8,  RS_CPU_SSE2, convert_u16_u8_sse2  },
+    { CONVERT_U16_U16, RS_CPU_SSE2, convert_u16_u16_sse2 },
+    { CONVERT_U8_F32,  RS_CPU_SSE2, convert_u8_f32_sse2  },
+    { CONVERT_U16_F32, RS_CPU_SSE2, convert_u16_f32_sse2 },
+    { CONVERT_U8_U16,  RS_CPU_AVX2, convert_u8_u16_avx2  },
+    { CONVERT_U16_U8,  RS_CPU_AVX2, convert_u16_u8_avx2  },
+    { CONVERT_U16_U16, RS_CPU_AVX2, convert_u16_u16_avx2 },
+    { CONVERT_U8_F32,  RS_CPU_AVX2, convert_u8_f32_avx2  },
+    { CONVERT_U16_F32, RS_CPU_AVX2, convert_u16_f32_avx2 },
+    { CONVERT_U8_F16,  RS_CPU_AVX2, convert_u8_f16_avx2  },
+    { CONVERT_U16_F16, RS_CPU_AVX2, convert_u16_f16_avx2 },
+#endif
+};
+
+static const char *level_names[] = { "c", "sse2", "ssse3", "avx2", "avx512bw" };
+
+static rs_cpu_level_t cpu_level = RS_CPU_C;
+
+
+void rs_unpack_init(void)
+{
+#ifdef RS_ARCH_X86
+    cpu_level = detect_cpu_level();
+#endif
+}
+
+
+rs_cpu_level_t rs_cpu_level(void)
+{
+    return cpu_level;
+}
+
+
+int rs_parse_cpu_opt(const char *name)
+{
+    if (strcasecmp(name, "auto") == 0) {
+        return RS_CPU_MAX;
+    }
+    for (int i = 0; i <= RS_CPU_MAX; i++) {
+        if (strcasecmp(name, level_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+const char *rs_cpu_level_name(rs_cpu_level_t level)
+{
+    return level_names[level];
+}
+
+
+func_unpack_row rs_get_unpack_row(unpack_kind_t kind, int max_level)
+{
+    func_unpack_row func = NULL;
+    int best = -1;
+
+    if (max_level > (int)cpu_level) {
+        max_level = cpu_level;
+    }
+    for (size_t i = 0; i < sizeof registry / sizeof registry[0]; i++) {
+        if (registry[i].kind == kind && (int)registry[i].level <= max_level &&
+            (int)registry[i].level > best) {
+            best = registry[i].level;
+            func = registry[i].func;
+        }
+    }
+    return func;
+}
+
+
+func_stream_copy rs_get_stream_copy(int max_level)
+{
+    func_stream_copy func = NULL;
+    int best = -1;
+
+    if (max_level > (int)cpu_level) {
+        max_level = cpu_level;
+    }
+    for (size_t i = 0; i < sizeof stream_copies / sizeof stream_copies[0]; i++) {
+        if ((int)stream_copies[i].level <= max_level &&
+            (int)stream_copies[i].level > best) {
+            best = stream_copies[i].level;
+            func = stream_copies[i].func;
+        }
+    }
+    return func;
+}
+
+
+func_decimate_row rs_get_decimate_row(int unit, int max_level)
+{
+    func_decimate_row func = NULL;
+    int best = -1;
+
+    if (max_level > (int)cpu_level) {
+        max_level = cpu_level;
+    }
+    for (size_t i = 0; i < sizeof decimators / sizeof decimators[0]; i++) {
+        if (decimators[i].unit == unit && (int)decimators[i].level <= max_level &&
+            (int)decimators[i].level > best) {
+            best = decimators[i].level;
+            func = decimators[i].func;
+        }
+    }
+    return func;
+}
+
+
+func_decimate_row rs_get_decimate_422(int luma)
+{
+    return luma ? decimate_uyvy_c : decimate_yuyv_c;
+}
+
+
+func_convert_row rs_get_convert_row(convert_kind_t kind, int max_level)
+{
+    func_convert_row func = NULL;
+    int best = -1;
+
+    if (max_level > (int)cpu_level) {
+        max_level = cpu_level;
+    }
+    for (size_t i = 0; i < sizeof converters / sizeof converters[0]; i++) {
+        if (converters[i].kind == kind && (int)converters[i].level <= max_level &&
+            (int)converters[i].level > best) {
+            best = converters[i].level;
+            func = converters[i].func;
+        }
+    }
+    return func;
+}
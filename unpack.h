@@ -0,0 +1,130 @@
+/*
+  unpack.h: row kernels for the packed source formats of vsrawsource
+
+  This file is a part of vsrawsource
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with Libav; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#ifndef VS_RAW_SOURCE_UNPACK_H
+#define VS_RAW_SOURCE_UNPACK_H
+
+#include <stdint.h>
+
+/* a row kernel splits one packed source row into planar rows.
+   dstp[k] receives the k-th component of each pixel, width is counted in
+   pixels (chroma pixels for the semi-planar formats).
+   the kernels write exactly width pixels but may read up to 9 bytes
+   beyond the row, which FRAME_PADDING absorbs. */
+typedef void (*func_unpack_row)(const uint8_t *srcp, uint8_t **dstp, int width);
+
+/* copies height rows of row_size bytes with non-temporal stores, which
+   bypass the cache on their way to memory. */
+typedef void (*func_stream_copy)(const uint8_t *srcp, int src_stride,
+                                 uint8_t *dstp, int dst_stride,
+                                 int row_size, int height);
+
+/* keeps every factor-th unit of unit bytes of a row, num_units of them.
+   no more than num_units * unit * factor bytes are read. */
+typedef void (*func_decimate_row)(const uint8_t *srcp, uint8_t *dstp,
+                                  int num_units, int factor);
+
+/* parameters of a sample conversion. integer outputs shift each sample
+   left by shift bits, or right with rounding when it is negative, and
+   clamp it to max. float outputs add bias to the integer sample and
+   multiply it by scale. */
+typedef struct {
+    int shift;
+    int max;
+    int bias;
+    float scale;
+} rs_convert_t;
+
+/* converts width samples of an integer row to another depth or to float.
+   reads and writes exactly width samples. */
+typedef void (*func_convert_row)(const uint8_t *srcp, uint8_t *dstp, int width,
+                                 const rs_convert_t *cv);
+
+typedef enum {
+    CONVERT_NONE,
+    CONVERT_U8_U16,     /* 8 bit to 9..16 bit */
+    CONVERT_U16_U8,     /* 9..16 bit to 8 bit */
+    CONVERT_U16_U16,    /* between 9..16 bit depths */
+    CONVERT_U8_F32,
+    CONVERT_U16_F32,
+    CONVERT_U8_F16,     /* half float */
+    CONVERT_U16_F16,
+    CONVERT_COUNT
+} convert_kind_t;
+
+typedef enum {
+    UNPACK_NONE,
+    UNPACK_DEINT2_8,    /* NV12/NV21 chroma */
+    UNPACK_DEINT2_16,   /* P010/P016/P210/P216 chroma */
+    UNPACK_DEINT3_8,    /* RGB24 */
+    UNPACK_DEINT3_16,   /* RGB48 */
+    UNPACK_DEINT4_8,    /* RGB32/AYUV */
+    UNPACK_YUYV,        /* dstp[0] is luma, dstp[1]/[2] take bytes 1/3 */
+    UNPACK_UYVY,        /* dstp[0] is luma, dstp[1]/[2] take bytes 0/2 */
+    UNPACK_SWAP16,      /* big-endian 16 bit planes */
+    UNPACK_SWAP32,      /* big-endian float planes */
+    UNPACK_DEINT2_16BE, /* big-endian P010/P016/P210/P216 chroma */
+    UNPACK_DEINT3_16BE, /* RGB48BE */
+    UNPACK_COUNT
+} unpack_kind_t;
+
+typedef enum {
+    RS_CPU_C,
+    RS_CPU_SSE2,
+    RS_CPU_SSSE3,
+    RS_CPU_AVX2,
+    RS_CPU_AVX512BW,
+    RS_CPU_MAX = RS_CPU_AVX512BW
+} rs_cpu_level_t;
+
+/* probes the cpu. called once from VapourSynthPluginInit. */
+void rs_unpack_init(void);
+
+/* the highest level the running cpu supports. */
+rs_cpu_level_t rs_cpu_level(void);
+
+/* maps a cpu_opt value ("auto", "c", "sse2", "ssse3", "avx2" or
+   "avx512bw") to a level. returns -1 for anything else. */
+int rs_parse_cpu_opt(const char *name);
+
+const char *rs_cpu_level_name(rs_cpu_level_t level);
+
+/* returns the fastest registered kernel for kind whose level is neither
+   above max_level nor above what the cpu supports. */
+func_unpack_row rs_get_unpack_row(unpack_kind_t kind, int max_level);
+
+/* returns the widest streaming copy usable under max_level, or NULL when
+   there is none (the c level). */
+func_stream_copy rs_get_stream_copy(int max_level);
+
+/* returns the fastest decimation for units of unit bytes (1, 2, 3, 4, 6
+   or 8) usable under max_level, or NULL for other sizes. */
+func_decimate_row rs_get_decimate_row(int unit, int max_level);
+
+/* returns the decimation of packed 4:2:2 rows in pairs of pixels, whose
+   first luma sample is byte luma (0 or 1) of a pair. every factor-th luma
+   sample is kept together with the chroma at the same position. */
+func_decimate_row rs_get_decimate_422(int luma);
+
+/* returns the fastest conversion of kind usable under max_level. */
+func_convert_row rs_get_convert_row(convert_kind_t kind, int max_level);
+
+#endif /* VS_RAW_SOURCE_UNPACK_H */
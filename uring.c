@@ -0,0 +1,245 @@
+/*
+  uring.c: minimal io_uring read queue for vsrawsource
+
+  This file is a part of vsrawsource
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with Libav; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "rawsource.h"
+#include "uring.h"
+
+#ifdef HAVE_IO_URING
+
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/* talks to the kernel directly instead of depending on liburing, only the
+   few operations needed for batched reads are implemented. */
+struct rs_uring {
+    int fd;
+    unsigned entries;
+    unsigned queued;
+
+    void *sq_ptr;
+    size_t sq_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+
+    void *cq_ptr;
+    size_t cq_size;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+
+rs_uring_t *rs_uring_create(unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof p);
+
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    rs_uring_t *ring = (rs_uring_t *)calloc(1, sizeof(rs_uring_t));
+    if (!ring) {
+        close(fd);
+        return NULL;
+    }
+    ring->fd = fd;
+    ring->entries = p.sq_entries;
+    ring->sq_ptr = MAP_FAILED;
+    ring->cq_ptr = MAP_FAILED;
+    ring->sqes = MAP_FAILED;
+
+    ring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_size > ring->sq_size) {
+            ring->sq_size = ring->cq_size;
+        }
+        ring->cq_size = ring->sq_size;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        goto fail;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            goto fail;
+        }
+    }
+    ring->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                      IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        goto fail;
+    }
+
+    uint8_t *sq = (uint8_t *)ring->sq_ptr;
+    ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+
+    uint8_t *cq = (uint8_t *)ring->cq_ptr;
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    return ring;
+
+fail:
+    rs_uring_destroy(ring);
+    return NULL;
+}
+
+
+void rs_uring_destroy(rs_uring_t *ring)
+{
+    if (!ring) {
+        return;
+    }
+    if (ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->entries * sizeof(struct io_uring_sqe));
+    }
+    if (ring->cq_ptr != MAP_FAILED && ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_size);
+    }
+    if (ring->sq_ptr != MAP_FAILED) {
+        munmap(ring->sq_ptr, ring->sq_size);
+    }
+    close(ring->fd);
+    free(ring);
+}
+
+
+unsigned rs_uring_space(const rs_uring_t *ring)
+{
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    return ring->entries - (*ring->sq_tail + ring->queued - head);
+}
+
+
+int rs_uring_queue_read(rs_uring_t *ring, int fd, void *buff, uint32_t size,
+                        int64_t offset, uint64_t user_data)
+{
+    if (rs_uring_space(ring) == 0) {
+        return -1;
+    }
+
+    unsigned index = (*ring->sq_tail + ring->queued) & *ring->sq_mask;
+    struct io_uring_sqe *sqe = ring->sqes + index;
+    memset(sqe, 0, sizeof *sqe);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buff;
+    sqe->len = size;
+    sqe->off = (uint64_t)offset;
+    sqe->user_data = user_data;
+    ring->sq_array[index] = index;
+    ring->queued++;
+
+    return 0;
+}
+
+
+int rs_uring_submit(rs_uring_t *ring, unsigned min_complete)
+{
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + ring->queued,
+                     __ATOMIC_RELEASE);
+    ring->queued = 0;
+
+    unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    for (;;) {
+        /* entries refused by an earlier failed call are still published in
+           the ring, so they are simply passed again. */
+        unsigned to_submit = *ring->sq_tail -
+                             __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        int ret = (int)syscall(__NR_io_uring_enter, ring->fd, to_submit,
+                               min_complete, flags, NULL, 0);
+        if (ret >= 0) {
+            return 0;
+        }
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+
+int rs_uring_reap(rs_uring_t *ring, uint64_t *user_data, int *result)
+{
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+
+    struct io_uring_cqe *cqe = ring->cqes + (head & *ring->cq_mask);
+    *user_data = cqe->user_data;
+    *result = cqe->res;
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+#else
+
+rs_uring_t *rs_uring_create(unsigned entries)
+{
+    return NULL;
+}
+
+void rs_uring_destroy(rs_uring_t *ring)
+{
+}
+
+unsigned rs_uring_space(const rs_uring_t *ring)
+{
+    return 0;
+}
+
+int rs_uring_queue_read(rs_uring_t *ring, int fd, void *buff, uint32_t size,
+                        int64_t offset, uint64_t user_data)
+{
+    return -1;
+}
+
+int rs_uring_submit(rs_uring_t *ring, unsigned min_complete)
+{
+    return -1;
+}
+
+int rs_uring_reap(rs_uring_t *ring, uint64_t *user_data, int *result)
+{
+    return 0;
+}
+
+#endif /* HAVE_IO_URING */
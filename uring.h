@@ -0,0 +1,49 @@
+/*
+  uring.h: minimal io_uring read queue for vsrawsource
+
+  This file is a part of vsrawsource
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with Libav; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#ifndef VS_RAW_SOURCE_URING_H
+#define VS_RAW_SOURCE_URING_H
+
+#include <stdint.h>
+
+typedef struct rs_uring rs_uring_t;
+
+/* returns NULL when io_uring is not available (not built in, or refused by
+   the kernel), callers are expected to fall back to plain positional reads. */
+rs_uring_t *rs_uring_create(unsigned entries);
+
+void rs_uring_destroy(rs_uring_t *ring);
+
+/* number of reads which can still be queued before the next submit. */
+unsigned rs_uring_space(const rs_uring_t *ring);
+
+/* queues a positional read. returns -1 if the submission queue is full. */
+int rs_uring_queue_read(rs_uring_t *ring, int fd, void *buff, uint32_t size,
+                        int64_t offset, uint64_t user_data);
+
+/* submits everything queued and waits until at least min_complete reads
+   have completed. returns -1 on failure. */
+int rs_uring_submit(rs_uring_t *ring, unsigned min_complete);
+
+/* pops one completion. returns 0 when there is none. */
+int rs_uring_reap(rs_uring_t *ring, uint64_t *user_data, int *result);
+
+#endif /* VS_RAW_SOURCE_URING_H */
@@ -0,0 +1,185 @@
+/*
+  workers.c: small thread pool splitting one frame into bands
+
+  This file is a part of vsrawsource
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with Libav; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#include "rawsource.h"
+#include "workers.h"
+
+struct rs_workers {
+    rs_mutex_t mutex;
+    rs_cond_t wake;
+    rs_cond_t done;
+    int num_threads;
+    int limit;
+    int active;
+    int helpers;
+    int max_helpers;
+    int started;
+    rs_thread_t *threads;
+    int quit;
+    int busy;
+    func_run_band func;
+    void *ctx;
+    int num_bands;
+    int next_band;
+    int pending;
+    int failed;
+};
+
+
+/* called with the mutex held, returns with it held. */
+static void run_bands(rs_workers_t *w)
+{
+    while (w->busy && w->next_band < w->num_bands) {
+        int band = w->next_band++;
+        func_run_band func = w->func;
+        void *ctx = w->ctx;
+        rs_mutex_unlock(&w->mutex);
+        int ret = func(ctx, band);
+        rs_mutex_lock(&w->mutex);
+        w->failed |= ret != 0;
+        if (--w->pending == 0) {
+            rs_cond_broadcast(&w->done);
+        }
+    }
+}
+
+
+static RS_THREAD_FUNC worker_thread(void *arg)
+{
+    rs_workers_t *w = (rs_workers_t *)arg;
+
+    rs_mutex_lock(&w->mutex);
+    while (!w->quit) {
+        if (w->busy && w->next_band < w->num_bands &&
+            w->helpers < w->max_helpers) {
+            w->helpers++;
+            run_bands(w);
+            w->helpers--;
+        } else {
+            rs_cond_wait(&w->wake, &w->mutex);
+        }
+    }
+    rs_mutex_unlock(&w->mutex);
+    return 0;
+}
+
+
+void rs_workers_destroy(rs_workers_t *w)
+{
+    if (!w) {
+        return;
+    }
+    rs_mutex_lock(&w->mutex);
+    w->quit = 1;
+    rs_cond_broadcast(&w->wake);
+    rs_mutex_unlock(&w->mutex);
+    for (int i = 0; i < w->started; i++) {
+        rs_thread_join(w->threads[i]);
+    }
+    rs_cond_destroy(&w->done);
+    rs_cond_destroy(&w->wake);
+    rs_mutex_destroy(&w->mutex);
+    free(w->threads);
+    free(w);
+}
+
+
+rs_workers_t *rs_workers_create(int num_threads, int limit)
+{
+    rs_workers_t *w = (rs_workers_t *)calloc(1, sizeof(rs_workers_t));
+    if (!w) {
+        return NULL;
+    }
+    rs_mutex_init(&w->mutex);
+    rs_cond_init(&w->wake);
+    rs_cond_init(&w->done);
+    w->num_threads = num_threads - 1;
+    w->limit = limit;
+    w->threads = (rs_thread_t *)calloc(w->num_threads + 1, sizeof(rs_thread_t));
+    if (!w->threads) {
+        rs_workers_destroy(w);
+        return NULL;
+    }
+    for (; w->started < w->num_threads; w->started++) {
+        if (rs_thread_create(w->threads + w->started, worker_thread, w) != 0) {
+            rs_workers_destroy(w);
+            return NULL;
+        }
+    }
+    return w;
+}
+
+
+void rs_workers_enter(rs_workers_t *w)
+{
+    rs_mutex_lock(&w->mutex);
+    w->active++;
+    rs_mutex_unlock(&w->mutex);
+}
+
+
+void rs_workers_leave(rs_workers_t *w)
+{
+    rs_mutex_lock(&w->mutex);
+    w->active--;
+    rs_mutex_unlock(&w->mutex);
+}
+
+
+int rs_workers_run(rs_workers_t *w, func_run_band func, void *ctx,
+                   int num_bands)
+{
+    rs_mutex_lock(&w->mutex);
+    /* the caller is one of the active requests, every other one keeps a
+       thread of its own busy. */
+    int max_helpers = w->limit - (w->active > 1 ? w->active : 1);
+    if (max_helpers > w->num_threads) {
+        max_helpers = w->num_threads;
+    }
+    if (w->busy || max_helpers <= 0) {
+        rs_mutex_unlock(&w->mutex);
+        for (int i = 0; i < num_bands; i++) {
+            if (func(ctx, i) != 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    w->busy = 1;
+    w->func = func;
+    w->ctx = ctx;
+    w->num_bands = num_bands;
+    w->next_band = 0;
+    w->pending = num_bands;
+    w->failed = 0;
+    w->max_helpers = max_helpers;
+    rs_cond_broadcast(&w->wake);
+
+    run_bands(w);
+    while (w->pending > 0) {
+        rs_cond_wait(&w->done, &w->mutex);
+    }
+    w->busy = 0;
+    int failed = w->failed;
+    rs_mutex_unlock(&w->mutex);
+    return failed ? -1 : 0;
+}
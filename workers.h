@@ -0,0 +1,52 @@
+/*
+  workers.h: small thread pool splitting one frame into bands
+
+  This file is a part of vsrawsource
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with Libav; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+
+#ifndef VS_RAW_SOURCE_WORKERS_H
+#define VS_RAW_SOURCE_WORKERS_H
+
+typedef struct rs_workers rs_workers_t;
+
+typedef int (*func_run_band)(void *ctx, int band);
+
+/* starts num_threads - 1 threads, the caller of rs_workers_run is the
+   last one. the pool and the requests being served never keep more than
+   limit threads running. returns NULL on failure. */
+rs_workers_t *rs_workers_create(int num_threads, int limit);
+
+void rs_workers_destroy(rs_workers_t *w);
+
+/* bracket every frame request, whether it ends up in rs_workers_run or
+   not, so that the pool knows how many threads the requests occupy. */
+void rs_workers_enter(rs_workers_t *w);
+
+void rs_workers_leave(rs_workers_t *w);
+
+/* calls func for every band from 0 to num_bands - 1 and returns when all
+   of them are done. idle threads and the caller take the bands one by one,
+   so faster threads end up doing more of them. only as many threads help
+   as the other requests in flight leave room for under the limit, and
+   while the pool is busy with another call, the caller runs all bands
+   itself instead of waiting, so concurrent frame requests never stack up
+   extra threads. returns nonzero when any of the bands did. */
+int rs_workers_run(rs_workers_t *w, func_run_band func, void *ctx,
+                   int num_bands);
+
+#endif /* VS_RAW_SOURCE_WORKERS_H */